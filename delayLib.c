@@ -0,0 +1,127 @@
+/*************************************************************************/
+/*  delayLib.c                                                           */
+/*                                                                       */
+/*  tickless delays. A delay sleeps with clock_nanosleep to an absolute  */
+/*  deadline, so periodic callers do not drift and are not rounded to    */
+/*  the tick. Deadlines are on CLOCK_MONOTONIC, which the programs do    */
+/*  not set, unless they go by the program clock; how late each wakeup   */
+/*  comes is kept in a histogram of powers of 2 of the caller            */
+/*                                                                       */
+/*************************************************************************/
+
+/* includes */
+#include "vxWorks.h"
+#include "stdio.h"
+#include "errno.h"
+#include "sysLib.h"
+#include "time.h"
+#include "delayLib.h"
+
+/* forward declarations */
+static STATUS delaySleep(clockid_t clock, long long deadline, DELAY_HIST* hist);
+static long long delayClock(clockid_t clock);
+static long long delayPercentile(DELAY_HIST* hist, double p);
+
+
+/*************************************************************************/
+/*  delays                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+/* sleep until the absolute CLOCK_MONOTONIC deadline, ns; one that has
+ * passed returns at once */
+STATUS delayUntil(long long deadline, DELAY_HIST* hist) {
+    return delaySleep(CLOCK_MONOTONIC, deadline, hist);
+}
+
+/* the same on CLOCK_REALTIME, which the programs set to 0 at their start */
+STATUS delayUntilRt(long long deadline, DELAY_HIST* hist) {
+    return delaySleep(CLOCK_REALTIME, deadline, hist);
+}
+
+STATUS delayNs(long long ns, DELAY_HIST* hist) {
+    return delayUntil(delayNow() + ns, hist);
+}
+
+/* CLOCK_MONOTONIC in ns */
+long long delayNow(void) {
+    return delayClock(CLOCK_MONOTONIC);
+}
+
+/* CLOCK_REALTIME in ns */
+long long delayNowRt(void) {
+    return delayClock(CLOCK_REALTIME);
+}
+
+/* ns in ticks of the system clock, rounded up, for the timeouts of the
+ * kernel calls that still count in ticks */
+int delayTicks(long long ns) {
+    long long rate = sysClkRateGet();
+
+    return (int)((ns * rate + 1000000000LL - 1) / 1000000000LL);
+}
+
+static STATUS delaySleep(clockid_t clock, long long deadline, DELAY_HIST* hist) {
+    struct timespec ts;
+    long long late, max;
+    int rc;
+
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while ((rc = clock_nanosleep(clock, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+        ;
+    if (rc != 0) {
+        errno = rc;
+        return ERROR;
+    }
+    if (hist == NULL)
+        return OK;
+
+    late = delayClock(clock) - deadline;
+    if (late < 0)
+        late = 0;
+    __atomic_fetch_add(&hist->cnt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, late, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->bucket[late ? 63 - __builtin_clzll(late) : 0], 1,
+            __ATOMIC_RELAXED);
+    max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (late > max && !__atomic_compare_exchange_n(&hist->max, &max, late,
+                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return OK;
+}
+
+static long long delayClock(clockid_t clock) {
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/*************************************************************************/
+/*  overshoot                                                            */
+/*                                                                       */
+/*************************************************************************/
+
+void delayShow(DELAY_HIST* hist) {
+    if (hist == NULL || hist->cnt == 0)
+        return;
+    printf("%s: %llu wakeups, late by %.3fms on average, p99 below %.3fms, "
+            "%.3fms at most\n", hist->name, hist->cnt,
+            (double)hist->sum / hist->cnt / 1e6,
+            delayPercentile(hist, 0.99) / 1e6, hist->max / 1e6);
+}
+
+/* upper bound of the bucket the percentile falls in, at most the max */
+static long long delayPercentile(DELAY_HIST* hist, double p) {
+    unsigned long long seen = 0;
+    int k;
+
+    for (k = 0; k < DELAY_BUCKETS - 1; k++) {
+        seen += hist->bucket[k];
+        if (seen >= p * hist->cnt)
+            return ((2LL << k) < hist->max) ? 2LL << k : hist->max;
+    }
+    return hist->max;
+}
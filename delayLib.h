@@ -0,0 +1,39 @@
+/*************************************************************************/
+/*  delayLib.h                                                           */
+/*                                                                       */
+/*  tickless delays: sleep to absolute deadlines in ns, independent of   */
+/*  the system clock rate, and keep the overshoot of the wakeups per     */
+/*  caller or class of delays                                            */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCdelayLibh
+#define __INCdelayLibh
+
+#include "vxWorks.h"
+
+#define DELAY_BUCKETS 64    /* bucket k: overshoot in [2^k, 2^(k+1)) ns */
+
+/* overshoot of the wakeups of one caller or class, e.g.
+ * static DELAY_HIST pacing = DELAY_HIST_INIT("pacing"); */
+typedef struct delay_hist {
+    const char*        name;
+    unsigned long long cnt;
+    long long          sum;
+    long long          max;
+    unsigned long long bucket[DELAY_BUCKETS];
+} DELAY_HIST;
+
+#define DELAY_HIST_INIT(name)   { (name), 0, 0, 0, { 0 } }
+
+/* deadlines on CLOCK_MONOTONIC, or with Rt on CLOCK_REALTIME for the
+ * callers that go by the program clock; hist may be NULL */
+STATUS    delayUntil(long long deadline, DELAY_HIST* hist);
+STATUS    delayUntilRt(long long deadline, DELAY_HIST* hist);
+STATUS    delayNs(long long ns, DELAY_HIST* hist);
+long long delayNow(void);
+long long delayNowRt(void);
+int       delayTicks(long long ns);
+void      delayShow(DELAY_HIST* hist);
+
+#endif /* __INCdelayLibh */
@@ -14,26 +14,145 @@
 #include "semLib.h"
 #include "taskLib.h"
 #include "kernelLib.h"
+#include "sysLib.h"
+#include "vxCpuLib.h"
+#include "time.h"
+#include "delayLib.h"
 
 /* defines */
+#ifndef THINK_TIME
 #define THINK_TIME   50     // ticks
+#endif
+#ifndef EAT_TIME
 #define EAT_TIME     10     // ticks
+#endif
 #define MAX_WAIT     100    // ticks
 #define MAX_SIM      100    // seconds
 #define STACK_SIZE   20000
 #define MIN_PHILOS   3
-#define MAX_PHILOS   20
-#define TIMESLICE    6
+#define MAX_PHILOS   4096
+#define BACKOFF_NS   10000000LL     // ns, unit of the backoff
+#define MAX_BACKOFF  64     // units
+#define TIMESLICE    100000000LL    // ns
+#define SAMPLE_TIME  1000000000LL   // ns between live samples
+#define STOP_TIME    5000000000LL   // ns a philosopher gets to stop
+#define SHOW_PHILOS  32     // per-philosopher table up to this many
+#define HIST_BUCKETS 16     // wait < 1ms, then [2^(k-1), 2^k) ms
+#define MAX_HELD     4      // locks a philosopher holds at once
+
+/* fork arbitration */
+#define STRATEGY_WAITER   0 // at most n-1 philosophers reach for the forks
+#define STRATEGY_ORDERED  1 // lower numbered fork first
+#define STRATEGY_CM       2 // Chandy-Misra: dirty forks are handed over on request
+#define STRATEGY_TRYLOCK  3 // second fork without waiting, else back off
+
+/* fork locking */
+#define PROTOCOL_FIFO     0 // binary semaphores, no inversion protection
+#define PROTOCOL_INHERIT  1 // mutex semaphores with priority inheritance
+#define PROTOCOL_CEILING  2 // immediate priority ceiling, raised on take
+
+/* priorities, the mixed scenario runs all of them on one CPU */
+#define PRIO_EQUAL   200
+#define PRIO_HIGH    120
+#define PRIO_MEDIUM  150
+#define PRIO_LOW     180
+#define PRIO_MONITOR 110
+
+#define THINKING 0
+#define HUNGRY   1
+#define EATING   2
+
+/* Chandy-Misra fork between philosophers f (left) and f+1 (right); its
+ * semaphore guards the fields. A hungry philosopher gets a dirty fork
+ * from a neighbour who is not eating, else leaves a request that the
+ * neighbour grants, with a clean fork, when done eating */
+typedef struct fork_state {
+    int holder;
+    int dirty;
+    int request;
+} t_fork;
+
+/* a fork; the statistics are updated by the task holding it. The
+ * ceiling is the highest priority of the two philosophers sharing it */
+typedef struct lock {
+    SEM_ID sem;
+    int ceiling;
+    int takes;
+    long long block_sum;        /* ns from asking for the lock to getting it */
+    long long block_max;
+} t_lock;
+
+/* priority of a philosopher and the locks it holds, for the ceiling */
+typedef struct philo_prio {
+    int base;
+    int cur;
+    int held_cnt;
+    t_lock* held[MAX_HELD];
+    int blocks;
+    long long block_sum;
+    long long block_max;
+    volatile long long blocked;     /* waiting for a lock since, or 0 */
+    volatile int stopped;           /* left the table, holds no fork */
+    int lock_errors;                /* takes that failed without timeout */
+} t_philo;
+
+/* meals and waits of a philosopher, written only by itself */
+typedef struct philo_stats {
+    int meals;
+    long long wait_sum;         /* ns from hungry to eating */
+    long long wait_max;
+    long long starve_max;       /* longest ns between two meals */
+    volatile long long last_meal;
+    unsigned int wait_hist[HIST_BUCKETS];
+} t_stats;
 
 /* task IDs */
-int tidPhilosopher[MAX_PHILOS];
+int* tidPhilosopher;
+int tidMonitor;
 
 /* Semaphore IDs */
-SEM_ID sidFork[MAX_PHILOS];	
+t_lock* forkLock;
+SEM_ID* sidWake;    // Chandy-Misra: a neighbour granted a fork
 SEM_ID waiter;	
+SEM_ID sidStopped;  // a philosopher left the table
+
+int strategy;
+int protocol;
+int mixed;
+int verbose;
+t_philo* philos;
+t_fork* forks;
+volatile int* state;
+volatile int stopping;
+long long start_ns;
+
+/* overshoot of the sleeps, apart for the monitor and the backoff */
+DELAY_HIST monitorDelays = DELAY_HIST_INIT("monitor samples");
+DELAY_HIST backoffDelays = DELAY_HIST_INIT("backoff");
 
 /* function declarations */
-void philosopher(int id, int max_philo, int delayTicks, int *eat_cnt);
+void philosopher(int id, int max_philo, int retry_ticks, t_stats* stats);
+STATUS forks_take(int id, int max_philo, int retry_ticks, unsigned int* seed,
+        int* backoff);
+void forks_give(int id, int max_philo);
+void cm_take(int id, int max_philo);
+void cm_give(int id, int max_philo);
+int  cm_neighbour(int fork, int id, int max_philo);
+void cm_lock(int id, int max_philo);
+void cm_unlock(int id, int max_philo);
+STATUS lock_take(t_lock* lock, int id, int timeout);
+void lock_failed(int id);
+void lock_give(t_lock* lock, int id);
+void prio_restore(int id);
+int  philo_prio(int id);
+void spend(int ticks, int busy);
+void blocking_show(int max_philo, t_stats* stats, int wait_time);
+void monitor(int max_philo, t_stats* stats);
+void stats_meal(t_stats* stats, long long hungry, long long eating);
+void stats_show(int max_philo, t_stats* stats, int nseconds);
+double jain_index(int max_philo, t_stats* stats);
+long long hist_percentile(unsigned int* hist, double p, long long max);
+long long now_ns(void);
 
 
 /*************************************************************************/
@@ -45,20 +164,39 @@ int main (void) {
     int philo_cnt = 0;
     int wait_time = 0;
     int nseconds = 0;
-    int eat_cnt[MAX_PHILOS];
-    int i;
+    t_stats* stats;
+    int i, prio, stopped;
+    char name[32];
+    cpuset_t cpus;
 	
-	kernelTimeSlice(TIMESLICE);
-    
-    for(i=0; i<MAX_PHILOS; i++) {
-        eat_cnt[i] = 0;
-    }
+	kernelTimeSlice(delayTicks(TIMESLICE));
     
+    strategy = -1;
+    protocol = -1;
+    mixed = -1;
+    verbose = -1;
+
     /* get number of philosophers */ 
     while ((philo_cnt < MIN_PHILOS) || (philo_cnt > MAX_PHILOS)) {
         printf("Enter number of philosophers [%d-%d]: ", MIN_PHILOS, MAX_PHILOS);
         scanf("%d", &philo_cnt);
     };
+    /* get the fork arbitration */
+    while ((strategy < STRATEGY_WAITER) || (strategy > STRATEGY_TRYLOCK)) {
+        printf("Enter fork arbitration [0 waiter, 1 resource ordering, "
+                "2 Chandy-Misra, 3 try-lock with backoff]: ");
+        scanf("%d", &strategy);
+    };
+    /* get the locking protocol of the forks and the priorities */
+    while ((protocol < PROTOCOL_FIFO) || (protocol > PROTOCOL_CEILING)) {
+        printf("Enter fork protocol [0 FIFO binary semaphore, "
+                "1 priority inheritance, 2 priority ceiling]: ");
+        scanf("%d", &protocol);
+    };
+    while ((mixed < 0) || (mixed > 1)) {
+        printf("Enter priorities [0 all equal, 1 high/low/medium on one CPU]: ");
+        scanf("%d", &mixed);
+    };
     /* get the waiting time to grab the second fork */ 
     while ((wait_time < 1) || (wait_time > MAX_WAIT)) {
         printf("Enter waiting time [1-%d ticks]: ", MAX_WAIT);
@@ -69,39 +207,117 @@ int main (void) {
         printf("Enter overall simulation time [1-%d s]: ", MAX_SIM);
         scanf("%d", &nseconds);
     };
+    while ((verbose < 0) || (verbose > 1)) {
+        printf("Print what the philosophers do [0 no, 1 yes]: ");
+        scanf("%d", &verbose);
+    };
 
     printf("\nSimulating %d philosophers with waiting time %d ticks for %d seconds ...\n\n",
             philo_cnt, wait_time, nseconds);
     
-    /* create binary semaphores */
+    tidPhilosopher = calloc(philo_cnt, sizeof(int));
+    forkLock = calloc(philo_cnt, sizeof(t_lock));
+    philos = calloc(philo_cnt, sizeof(t_philo));
+    sidWake = calloc(philo_cnt, sizeof(SEM_ID));
+    forks = calloc(philo_cnt, sizeof(t_fork));
+    state = calloc(philo_cnt, sizeof(int));
+    stats = calloc(philo_cnt, sizeof(t_stats));
+    if (tidPhilosopher == NULL || forkLock == NULL || philos == NULL || sidWake == NULL
+            || forks == NULL || state == NULL || stats == NULL) {
+        printf("Error calloc\n");
+        return(1);
+    }
+
+    /* create binary semaphores; Chandy-Misra starts with every fork dirty
+     * at an odd numbered philosopher (at 0 for n-1 and 0 if n is odd), so
+     * even ones go first and no chain of precedence is longer than 3 */
     for (i=0; i<philo_cnt; i++) {
-        sidFork[i] = semBCreate(SEM_Q_FIFO, SEM_FULL);
+        philos[i].base = philos[i].cur = philo_prio(i);
+        forkLock[i].ceiling = philo_prio(i);
+        if (philo_prio((i + 1) % philo_cnt) < forkLock[i].ceiling)
+            forkLock[i].ceiling = philo_prio((i + 1) % philo_cnt);
+        if (protocol == PROTOCOL_FIFO)
+            forkLock[i].sem = semBCreate(SEM_Q_FIFO, SEM_FULL);
+        else
+            forkLock[i].sem = semMCreate(SEM_Q_PRIORITY
+                    | ((protocol == PROTOCOL_INHERIT) ? SEM_INVERSION_SAFE : 0));
+        sidWake[i] = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+        forks[i].holder = (i % 2 == 1) ? i : (i + 1) % philo_cnt;
+        forks[i].dirty = 1;
     }
     waiter = semCCreate(SEM_Q_FIFO, philo_cnt-1);
+    sidStopped = semCCreate(SEM_Q_FIFO, 0);
 
     /* spawn (create and start) tasks */
+    start_ns = now_ns();
+    for (i=0; i<philo_cnt; i++)
+        stats[i].last_meal = start_ns;
     for (i=0; i<philo_cnt; i++) {
-        tidPhilosopher[i] = taskSpawn("tPhilosopher_" + (char)i, 200, 0, STACK_SIZE,
-                (FUNCPTR)philosopher, i, philo_cnt, wait_time, (int)eat_cnt, 0, 0, 0, 0, 0, 0);
+        snprintf(name, sizeof(name), "tPhilosopher_%d", i);
+        tidPhilosopher[i] = taskCreate(name, philos[i].base, 0, STACK_SIZE,
+                (FUNCPTR)philosopher, i, philo_cnt, wait_time, (_Vx_usr_arg_t)stats, 0, 0, 0, 0, 0, 0);
+        if (tidPhilosopher[i] == ERROR) {
+            printf("Error taskCreate\n");
+            philo_cnt = i;
+            break;
+        }
+        /* the medium ones can only delay a low one holding a fork if they
+         * compete for the same CPU */
+        if (mixed) {
+            CPUSET_ZERO(cpus);
+            CPUSET_SET(cpus, 0);
+            if (taskCpuAffinitySet(tidPhilosopher[i], cpus) == ERROR)
+                printf("Warning: %s not bound to CPU 0\n", name);
+        }
+        taskActivate(tidPhilosopher[i]);
     }
+    tidMonitor = taskSpawn("tMonitor", PRIO_MONITOR, 0, STACK_SIZE, (FUNCPTR)monitor,
+            philo_cnt, (_Vx_usr_arg_t)stats, 0, 0, 0, 0, 0, 0, 0, 0);
 
     /* run for the given simulation time */
-    taskDelay(nseconds*60);
+    delayNs(nseconds * 1000000000LL, NULL);
     
-    /* delete tasks and semaphores */
-    for (i=0; i<philo_cnt; i++) {
-        taskDelete(tidPhilosopher[i]);
+    /* the philosophers leave after their next meal, with the forks on the
+     * table, so that no fork is deleted while taken */
+    taskDelete(tidMonitor);
+    stopping = 1;
+    for (stopped=0; stopped<philo_cnt; stopped++) {
+        if (semTake(sidStopped, delayTicks(STOP_TIME)) == ERROR)
+            break;
+    }
+    if (stopped < philo_cnt) {
+        printf("Warning: %d philosophers did not stop, deleted\n",
+                philo_cnt - stopped);
+        /* highest priority first: a deleted task still has to run to its
+         * next cancellation point, which it does not under busy ones */
+        for (prio=PRIO_HIGH; prio<=PRIO_EQUAL; prio++) {
+            for (i=0; i<philo_cnt; i++) {
+                if (philo_prio(i) == prio && !philos[i].stopped)
+                    taskDelete(tidPhilosopher[i]);
+            }
+        }
     }
     for (i=0; i<philo_cnt; i++) {
-        semDelete(sidFork[i]);
+        if (semDelete(forkLock[i].sem) == ERROR)
+            printf("Warning: fork %d still taken, not deleted\n", i);
+        semDelete(sidWake[i]);
     }
+    semDelete(waiter);
+    semDelete(sidStopped);
 
     printf("\n\nAll philosophers stopped.\n");	
-    printf("Eat counters:");	
-    for(i=0; i<philo_cnt; i++) {
-        printf(" %d", eat_cnt[i]);
-    }
-    printf("\n\n");	
+    stats_show(philo_cnt, stats, nseconds);
+    blocking_show(philo_cnt, stats, wait_time);
+    delayShow(&monitorDelays);
+    delayShow(&backoffDelays);
+
+    free(tidPhilosopher);
+    free(forkLock);
+    free(philos);
+    free(sidWake);
+    free(forks);
+    free((void*)state);
+    free(stats);
     return(0);
 }   
 
@@ -111,24 +327,486 @@ int main (void) {
 /*                                                                       */
 /*************************************************************************/
 
-void philosopher(int id, int max_philo, int delayTicks, int *eat_cnt) {
-    while (1) {
-        int left, right;
-        left = id;
-        right = (id == 0) ? max_philo - 1 : id - 1;
-        printf("Philosopher %d - start thinking.\n", id);
-        taskDelay(THINK_TIME);
-        // take the fork on the left
+void philosopher(int id, int max_philo, int retry_ticks, t_stats* stats) {
+    unsigned int seed = id;
+    int backoff = 1;
+    long long hungry;
+
+    while (!stopping) {
+        if (verbose)
+            printf("Philosopher %d - start thinking.\n", id);
+        spend(THINK_TIME, mixed && philos[id].base == PRIO_MEDIUM);
+        if (stopping)
+            break;
+        hungry = now_ns();
+        if (strategy == STRATEGY_CM)
+            cm_take(id, max_philo);
+        else if (forks_take(id, max_philo, retry_ticks, &seed, &backoff) == ERROR)
+            break;      /* stopped while retrying, holds no fork */
+        /* forks got after the stop go back uneaten, so that a chain of
+         * philosophers waiting on each other unwinds without a meal each */
+        if (!stopping) {
+            stats_meal(&stats[id], hungry, now_ns());
+            if (verbose)
+                printf("Philosopher %d - start eating.\n", id);
+            spend(EAT_TIME, mixed);
+            stats[id].meals++;
+        }
+        if (strategy == STRATEGY_CM)
+            cm_give(id, max_philo);
+        else
+            forks_give(id, max_philo);
+    };
+    philos[id].stopped = 1;
+    semGive(sidStopped);
+}
+
+/* one fork after the other, waiting retry_ticks in between. A take that
+ * fails puts the first fork back and retries like the try-lock; ERROR
+ * if the philosophers stop meanwhile, then no fork is held */
+STATUS forks_take(int id, int max_philo, int retry_ticks, unsigned int* seed,
+        int* backoff) {
+    int left, right, first, second;
+
+    left = id;
+    right = (id == 0) ? max_philo - 1 : id - 1;
+    if (strategy == STRATEGY_WAITER)
         semTake(waiter, WAIT_FOREVER);
-        semTake(sidFork[left], WAIT_FOREVER);
-        taskDelay(delayTicks);
-        // take the fork on the right
-        semTake(sidFork[right], WAIT_FOREVER);
-        printf("Philosopher %d - start eating.\n", id);
-        taskDelay(EAT_TIME);
-        eat_cnt[id]++;
-        semGive(sidFork[left]);
-        semGive(sidFork[right]);
+
+    /* ordering breaks the cycle: every philosopher takes the lower numbered
+     * fork first, its right one, except philosopher 0, whose right one is
+     * fork n-1, so it takes its left one first */
+    first = left;
+    second = right;
+    if (strategy == STRATEGY_ORDERED && right < left) {
+        first = right;
+        second = left;
+    }
+
+    while (1) {
+        // take the first fork
+        if (lock_take(&forkLock[first], id, WAIT_FOREVER) == ERROR) {
+            lock_failed(id);
+        }
+        else {
+            taskDelay(retry_ticks);
+            // take the second fork
+            if (lock_take(&forkLock[second], id, (strategy == STRATEGY_TRYLOCK)
+                        ? NO_WAIT : WAIT_FOREVER) == OK) {
+                *backoff = 1;
+                return OK;
+            }
+            if (strategy != STRATEGY_TRYLOCK)
+                lock_failed(id);
+            lock_give(&forkLock[first], id);
+        }
+
+        /* retry after a random, growing delay */
+        if (stopping) {
+            if (strategy == STRATEGY_WAITER)
+                semGive(waiter);
+            return ERROR;
+        }
+        delayNs((1 + rand_r(seed) % *backoff) * BACKOFF_NS, &backoffDelays);
+        if (*backoff < MAX_BACKOFF)
+            *backoff *= 2;
+    }
+}
+
+void forks_give(int id, int max_philo) {
+    lock_give(&forkLock[id], id);
+    lock_give(&forkLock[(id == 0) ? max_philo - 1 : id - 1], id);
+    if (strategy == STRATEGY_WAITER)
         semGive(waiter);
-    };
+}
+
+
+/*************************************************************************/
+/*  Chandy-Misra                                                         */
+/*                                                                       */
+/*  only the two neighbours of a philosopher ever contend with it, so    */
+/*  there is no global lock; the clean/dirty rule keeps the precedence   */
+/*  graph acyclic, which rules out deadlock and starvation               */
+/*                                                                       */
+/*************************************************************************/
+
+void cm_take(int id, int max_philo) {
+    int f[2], i;
+
+    f[0] = id;
+    f[1] = (id == 0) ? max_philo - 1 : id - 1;
+    cm_lock(id, max_philo);
+    state[id] = HUNGRY;
+    while (1) {
+        for (i = 0; i < 2; i++) {
+            if (forks[f[i]].holder == id)
+                continue;
+            if (forks[f[i]].dirty && state[forks[f[i]].holder] != EATING) {
+                forks[f[i]].holder = id;
+                forks[f[i]].dirty = 0;
+                forks[f[i]].request = 0;
+            }
+            else {
+                forks[f[i]].request = 1;
+            }
+        }
+        if (forks[f[0]].holder == id && forks[f[1]].holder == id)
+            break;
+        cm_unlock(id, max_philo);
+        semTake(sidWake[id], WAIT_FOREVER);
+        cm_lock(id, max_philo);
+    }
+    state[id] = EATING;
+    cm_unlock(id, max_philo);
+}
+
+/* done eating: the forks get dirty, requested ones go to the neighbour */
+void cm_give(int id, int max_philo) {
+    int f[2], i, other;
+
+    f[0] = id;
+    f[1] = (id == 0) ? max_philo - 1 : id - 1;
+    cm_lock(id, max_philo);
+    state[id] = THINKING;
+    for (i = 0; i < 2; i++) {
+        forks[f[i]].dirty = 1;
+        if (forks[f[i]].request) {
+            other = cm_neighbour(f[i], id, max_philo);
+            forks[f[i]].holder = other;
+            forks[f[i]].dirty = 0;
+            forks[f[i]].request = 0;
+            semGive(sidWake[other]);
+        }
+    }
+    cm_unlock(id, max_philo);
+}
+
+/* the other philosopher sharing a fork */
+int cm_neighbour(int fork, int id, int max_philo) {
+    return (fork == id) ? (id + 1) % max_philo : fork;
+}
+
+/* both fork semaphores, lower numbered first; a take that fails puts
+ * the first one back and retries, since the fork state must be handed
+ * on even while stopping */
+void cm_lock(int id, int max_philo) {
+    int right = (id == 0) ? max_philo - 1 : id - 1;
+    t_lock* first = &forkLock[(id < right) ? id : right];
+    t_lock* second = &forkLock[(id < right) ? right : id];
+
+    while (1) {
+        if (lock_take(first, id, WAIT_FOREVER) == OK) {
+            if (lock_take(second, id, WAIT_FOREVER) == OK)
+                return;
+            lock_give(first, id);
+        }
+        lock_failed(id);
+        delayNs(BACKOFF_NS, &backoffDelays);
+    }
+}
+
+void cm_unlock(int id, int max_philo) {
+    int right = (id == 0) ? max_philo - 1 : id - 1;
+
+    lock_give(&forkLock[(id < right) ? right : id], id);
+    lock_give(&forkLock[(id < right) ? id : right], id);
+}
+
+
+/*************************************************************************/
+/*  fork locks                                                           */
+/*                                                                       */
+/*  with priority inheritance the kernel lends the priority of a waiter  */
+/*  to the holder; with the immediate ceiling protocol the taker runs at */
+/*  the ceiling of the fork from before taking it until it gives it, so */
+/*  a lower priority holder is never preempted by a medium task while a  */
+/*  higher one waits for it                                              */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS lock_take(t_lock* lock, int id, int timeout) {
+    t_philo* philo = &philos[id];
+    long long start = now_ns(), block;
+
+    if (protocol == PROTOCOL_CEILING && lock->ceiling < philo->cur) {
+        taskPrioritySet(0, lock->ceiling);
+        philo->cur = lock->ceiling;
+    }
+    philo->blocked = start;
+    if (semTake(lock->sem, timeout) == ERROR) {
+        philo->blocked = 0;
+        if (protocol == PROTOCOL_CEILING)
+            prio_restore(id);
+        return ERROR;
+    }
+    philo->blocked = 0;
+    block = now_ns() - start;
+    lock->takes++;
+    lock->block_sum += block;
+    if (block > lock->block_max)
+        lock->block_max = block;
+    philo->blocks++;
+    philo->block_sum += block;
+    if (block > philo->block_max)
+        philo->block_max = block;
+    if (philo->held_cnt < MAX_HELD)
+        philo->held[philo->held_cnt++] = lock;
+    return OK;
+}
+
+/* a take without timeout failed, e.g. the host mutex refused it */
+void lock_failed(int id) {
+    philos[id].lock_errors++;
+}
+
+void lock_give(t_lock* lock, int id) {
+    t_philo* philo = &philos[id];
+    int i;
+
+    for (i = 0; i < philo->held_cnt; i++) {
+        if (philo->held[i] == lock) {
+            philo->held[i] = philo->held[--philo->held_cnt];
+            break;
+        }
+    }
+    semGive(lock->sem);
+    if (protocol == PROTOCOL_CEILING)
+        prio_restore(id);
+}
+
+/* back to the highest ceiling of the locks still held, or the base */
+void prio_restore(int id) {
+    t_philo* philo = &philos[id];
+    int i, prio = philo->base;
+
+    for (i = 0; i < philo->held_cnt; i++) {
+        if (philo->held[i]->ceiling < prio)
+            prio = philo->held[i]->ceiling;
+    }
+    if (prio != philo->cur) {
+        taskPrioritySet(0, prio);
+        philo->cur = prio;
+    }
+}
+
+/* mixed: philosophers 0, 3, 6, ... high, 1, 4, ... low and 2, 5, ...
+ * medium, so every high one shares a fork with a low one */
+int philo_prio(int id) {
+    if (!mixed)
+        return PRIO_EQUAL;
+    return (id % 3 == 0) ? PRIO_HIGH : (id % 3 == 1) ? PRIO_LOW : PRIO_MEDIUM;
+}
+
+/* sleep, or with busy keep the CPU for that long: in the mixed scenario
+ * meals take CPU time, so a preempted holder of a fork gives it back
+ * later, and the medium philosophers think on the CPU too, which is the
+ * load that preempts the low ones */
+void spend(int ticks, int busy) {
+    struct timespec ts;
+    long long end;
+
+    if (!busy) {
+        taskDelay(ticks);
+        return;
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    end = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec
+        + (long long)ticks * 1000000000LL / sysClkRateGet();
+    do {
+        taskDelay(0);           /* lets taskDelete through */
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    } while ((long long)ts.tv_sec * 1000000000LL + ts.tv_nsec < end
+            && !stopping);
+}
+
+/* blocking on the forks by priority and, for small tables, by fork */
+void blocking_show(int max_philo, t_stats* stats, int wait_time) {
+    static const int prio[] = { PRIO_HIGH, PRIO_MEDIUM, PRIO_LOW, PRIO_EQUAL };
+    long long block_sum, block_max, now = now_ns();
+    int i, k, cnt, meals, blocks, errors = 0;
+
+    printf("%-12s %7s %7s %10s %10s\n", "PRIORITY", "PHILOS", "MEALS",
+            "AVG BLOCK", "MAX BLOCK");
+    for (k = 0; k < (int)(sizeof(prio) / sizeof(prio[0])); k++) {
+        cnt = meals = blocks = 0;
+        block_sum = block_max = 0;
+        for (i = 0; i < max_philo; i++) {
+            if (philos[i].base != prio[k])
+                continue;
+            cnt++;
+            meals += stats[i].meals;
+            blocks += philos[i].blocks;
+            errors += philos[i].lock_errors;
+            block_sum += philos[i].block_sum;
+            if (philos[i].block_max > block_max)
+                block_max = philos[i].block_max;
+            /* still waiting when stopped */
+            if (philos[i].blocked != 0 && now - philos[i].blocked > block_max)
+                block_max = now - philos[i].blocked;
+        }
+        if (cnt > 0)
+            printf("%-12d %7d %7d %9.3fs %9.3fs\n", prio[k], cnt, meals,
+                    blocks ? block_sum / 1e9 / blocks : 0.0, block_max / 1e9);
+    }
+    printf("critical section %d ticks (%d between the forks, %d eating)\n",
+            wait_time + EAT_TIME, wait_time, EAT_TIME);
+    if (errors > 0)
+        printf("%d fork takes failed and were retried\n", errors);
+    printf("\n");
+
+    if (max_philo > SHOW_PHILOS)
+        return;
+    printf("%-12s %7s %7s %10s %10s\n", "FORK", "CEILING", "TAKES",
+            "AVG BLOCK", "MAX BLOCK");
+    for (i = 0; i < max_philo; i++)
+        printf("%-12d %7d %7d %9.3fs %9.3fs\n", i, forkLock[i].ceiling,
+                forkLock[i].takes, forkLock[i].takes
+                    ? forkLock[i].block_sum / 1e9 / forkLock[i].takes : 0.0,
+                forkLock[i].block_max / 1e9);
+    printf("\n");
+}
+
+
+/*************************************************************************/
+/*  fairness                                                             */
+/*                                                                       */
+/*  every philosopher accounts its own waits, tMonitor samples them      */
+/*  while they run and main summarises them at the end                   */
+/*                                                                       */
+/*************************************************************************/
+
+/* the philosopher got both forks */
+void stats_meal(t_stats* stats, long long hungry, long long eating) {
+    long long wait = eating - hungry;
+    long long ms = wait / 1000000;
+    int k = 0;
+
+    while (ms > 0 && k < HIST_BUCKETS - 1) {
+        ms >>= 1;
+        k++;
+    }
+    stats->wait_hist[k]++;
+    stats->wait_sum += wait;
+    if (wait > stats->wait_max)
+        stats->wait_max = wait;
+    if (eating - stats->last_meal > stats->starve_max)
+        stats->starve_max = eating - stats->last_meal;
+    stats->last_meal = eating;
+}
+
+/* once per SAMPLE_TIME: throughput, fairness so far and the philosopher
+ * waiting longest for a meal right now */
+void monitor(int max_philo, t_stats* stats) {
+    long long meals, last = 0, now, starving;
+    long long next = delayNow();
+    int i;
+
+    /* on absolute deadlines, so the samples do not drift */
+    while (1) {
+        next += SAMPLE_TIME;
+        delayUntil(next, &monitorDelays);
+        now = now_ns();
+        meals = 0;
+        starving = 0;
+        for (i = 0; i < max_philo; i++) {
+            meals += stats[i].meals;
+            if (now - stats[i].last_meal > starving)
+                starving = now - stats[i].last_meal;
+        }
+        printf("%4llds: %.1f meals/s, fairness %.4f, longest starving %.3fs\n",
+                (now - start_ns) / 1000000000, (meals - last) * 1e9 / SAMPLE_TIME,
+                jain_index(max_philo, stats), starving / 1e9);
+        last = meals;
+    }
+}
+
+void stats_show(int max_philo, t_stats* stats, int nseconds) {
+    unsigned int hist[HIST_BUCKETS] = { 0 };
+    long long meals = 0, waits = 0, wait_sum = 0, wait_max = 0;
+    long long starve, starve_max = 0, now = now_ns();
+    int i, k, cnt, starve_id = 0;
+
+    if (max_philo <= SHOW_PHILOS)
+        printf("%-12s %7s %10s %10s %10s %10s\n", "PHILOSOPHER", "MEALS",
+                "AVG WAIT", "P99 WAIT", "MAX WAIT", "STARVED");
+    for (i = 0; i < max_philo; i++) {
+        /* a philosopher still hungry at the end starves until now */
+        starve = stats[i].starve_max;
+        if (now - stats[i].last_meal > starve)
+            starve = now - stats[i].last_meal;
+        for (k = 0, cnt = 0; k < HIST_BUCKETS; k++) {
+            hist[k] += stats[i].wait_hist[k];
+            cnt += stats[i].wait_hist[k];
+        }
+        waits += cnt;
+        meals += stats[i].meals;
+        wait_sum += stats[i].wait_sum;
+        if (stats[i].wait_max > wait_max)
+            wait_max = stats[i].wait_max;
+        if (starve > starve_max) {
+            starve_max = starve;
+            starve_id = i;
+        }
+        if (max_philo <= SHOW_PHILOS)
+            printf("%-12d %7d %9.3fs %9.3fs %9.3fs %9.3fs\n", i, stats[i].meals,
+                    cnt ? stats[i].wait_sum / 1e9 / cnt : 0.0,
+                    hist_percentile(stats[i].wait_hist, 0.99, stats[i].wait_max) / 1e9,
+                    stats[i].wait_max / 1e9, starve / 1e9);
+    }
+
+    printf("\n%-16s %9s\n", "WAIT", "COUNT");
+    for (k = 0; k < HIST_BUCKETS; k++) {
+        if (hist[k] == 0)
+            continue;
+        if (k == 0)
+            printf("%6s-%6dms %9u\n", "0", 1, hist[k]);
+        else if (k == HIST_BUCKETS - 1)
+            printf("%6d-%6sms %9u\n", 1 << (k - 1), "", hist[k]);
+        else
+            printf("%6d-%6dms %9u\n", 1 << (k - 1), 1 << k, hist[k]);
+    }
+    printf("\n%lld meals, %.1f meals/s, fairness (Jain) %.4f\n", meals,
+            (double)meals / nseconds, jain_index(max_philo, stats));
+    if (waits > 0)
+        printf("wait for forks: avg %.3fs, p50 %.3fs, p99 %.3fs, max %.3fs\n",
+                wait_sum / 1e9 / waits, hist_percentile(hist, 0.5, wait_max) / 1e9,
+                hist_percentile(hist, 0.99, wait_max) / 1e9, wait_max / 1e9);
+    printf("longest starvation %.3fs (philosopher %d)\n\n", starve_max / 1e9,
+            starve_id);
+}
+
+/* (sum x)^2 / (n sum x^2) over the meals: 1 if all ate equally often,
+ * 1/n if one philosopher had every meal */
+double jain_index(int max_philo, t_stats* stats) {
+    double sum = 0, sq = 0;
+    int i;
+
+    for (i = 0; i < max_philo; i++) {
+        sum += stats[i].meals;
+        sq += (double)stats[i].meals * stats[i].meals;
+    }
+    return (sq > 0) ? sum * sum / (max_philo * sq) : 1.0;
+}
+
+/* upper bound, in ns, of the bucket holding the p-quantile, at most max */
+long long hist_percentile(unsigned int* hist, double p, long long max) {
+    long long cnt = 0, seen = 0, bound;
+    int k;
+
+    for (k = 0; k < HIST_BUCKETS; k++)
+        cnt += hist[k];
+    for (k = 0; k < HIST_BUCKETS; k++) {
+        seen += hist[k];
+        if (seen > 0 && seen >= p * cnt)
+            break;
+    }
+    bound = (k >= HIST_BUCKETS - 1) ? max : (1LL << k) * 1000000;
+    return (bound < max) ? bound : max;
+}
+
+long long now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
 }
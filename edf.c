@@ -10,58 +10,352 @@
 #include "vxWorks.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "string.h"
+#include "math.h"
+#include "limits.h"
 #include "semLib.h"
 #include "taskLib.h"
+#include "vxCpuLib.h"
 #include "kernelLib.h"
 #include "tickLib.h"
 #include "time.h"
 #include "sigLib.h"
 #include "errno.h"
+#include "traceLib.h"
+#include "wheelLib.h"
+#include "delayLib.h"
 
 /* defines */
 #define STACK_SIZE    20000
 #define MAX_SECONDS   1000
-#define MAX_PERIODIC  3
+#define MAX_SIM_SECONDS 1000000
 #define MAX_APERIODIC 3
-#define MAX_PERIOD    100
-#define MAX_DEADLINE  100
+#define MAX_ARRIVAL   100000000LL  // us
+#define SERVER_QUEUE  1024
+#define MAX_BUSY_ITER 100000
+#define MAX_PERIOD    100000000LL  // us
+#define MAX_DEADLINE  MAX_PERIOD   // us
 #define MAX_PRIO      102
+#ifdef VXH_PRIO_LOWEST
+#define MIN_PRIO      VXH_PRIO_LOWEST   // host: lower ones share a level with BG_PRIO
+#else
+#define MIN_PRIO      254
+#endif
+#define BG_PRIO       255
+#define BURN_SLICE    100000LL     // ns
+#define JOB_QUEUE     16
+#define CALIB_TIME    10000000LL   // ns
+#define MAX_CORES     32
+
+#define NSEC_PER_SEC  1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_USEC 1000LL
 
 #define WAITING 0
 #define READY   1
 #define RUNNING 2
 #define DONE    3
+#define LATE    4
+
+#define TYPE_PERIODIC 0
+#define TYPE_ARRIVAL  1
+
+/* overrun policies */
+#define POLICY_SKIP     0   // skip the next job
+#define POLICY_ABORT    1   // abort the current job
+#define POLICY_DEMOTE   2   // finish the job in background
+#define POLICY_CONTINUE 3   // finish the job and record its tardiness
+
+#define ADMIT_OK      0
+#define ADMIT_UTIL    1
+#define ADMIT_DEMAND  2
+#define ADMIT_DENSITY 3
+
+/* multicore modes */
+#define MODE_PARTITIONED_FF 0   // first-fit decreasing onto per-core EDF
+#define MODE_PARTITIONED_WF 1   // worst-fit decreasing onto per-core EDF
+#define MODE_GLOBAL         2   // one EDF ranking over all cores
+
+#define LOG_INFO    TRACE_INFO
+#define LOG_WARNING TRACE_WARNING
+#define LOG_ERROR   TRACE_ERROR
+#define LOG_DEBUG   TRACE_DEBUG
+#define TIMELINE    "edf.json"  // Chrome trace-event file
 
-#define LOG_INFO    0
-#define LOG_WARNING 1
-#define LOG_ERROR   2
-#define LOG_DEBUG   3
+/* trace events, formats in ev_formats */
+#define EV_CLOCK_ERROR  0
+#define EV_TIMER_SET    1
+#define EV_TIMER_ERROR  2
+#define EV_IN_TIME      3
+#define EV_MISSED       4
+#define EV_SKIPPED      5
+#define EV_ACTIVATED    6
+#define EV_AP_DROPPED   7
+#define EV_AP_ARRIVED   8
+#define EV_AP_DONE      9
+#define EV_STARTED      10
+#define EV_OVERRUN      11
+#define EV_ABORTED      12
+#define EV_FINISHED     13
+#define EV_CNT          14
 
 typedef int bool;
 #define true  1
 #define false 0
 
+/* times are held as 64-bit nanoseconds since the clock was set to 0 */
+typedef long long nsec_t;
+
+/* running count, sum and extremes of a time */
+typedef struct stat_param {
+    int cnt;
+    nsec_t sum;
+    nsec_t min;
+    nsec_t max;
+} t_stat;
+
+/* task parameters, shared by the scheduler and the periodic task; the
+ * scheduler counts released jobs, the task counts finished ones */
 typedef struct task_param {
-    int period;
-    int exec_time;
+    nsec_t period;
+    nsec_t deadline;
+    nsec_t exec_time;       /* budget, used for admission */
+    nsec_t actual_time;     /* execution time the jobs really need */
+    int policy;
     int id;
+    int core;               /* partitioned: core the task is bound to */
+    char name[20];
+    SEM_ID release_sem;
+    nsec_t job_deadline[JOB_QUEUE];
+    nsec_t job_release[JOB_QUEUE];  /* nominal release of the queued jobs */
+    volatile unsigned int released;
+    volatile unsigned int finished;
+    volatile unsigned int abort_job;    /* job to abort, by index */
+    volatile int skip;      /* skip the next release */
+    volatile int demoted;   /* running in background after an overrun */
+    int overruns;
+    int aborted;
+    int skipped;
+    int late;
+    nsec_t consumed;
+    nsec_t tardiness_max;
+    t_stat jitter;          /* release handled after its nominal time */
+    t_stat latency;         /* start after the nominal release */
+    t_stat response;        /* finish after the nominal release */
+    t_stat lateness;        /* finish after the deadline, < 0 if early */
+    nsec_t sim_consumed;    /* simulation: progress of the current job */
+    int sim_started;
+    int sim_overrun;
 } t_param;
 
 typedef struct queue_param {
-    struct timespec qt;
-    int period;
-    int id;
+    nsec_t qt;              /* next event: deadline or release */
+    nsec_t release;         /* next release */
+    nsec_t abs_deadline;    /* absolute deadline of the current job */
+    nsec_t period;
+    nsec_t deadline;
+    t_param* param;
+    int id;                 /* task ID, source index for arrivals */
+    int type;
     int status;
+    int prio;               /* priority last set in the kernel */
+    int active_idx;
+    bool moved;             /* queued for active_flush */
 } q_param;
 
+/* aperiodic event source with its response-time statistics */
+typedef struct aperiodic_param {
+    nsec_t interarrival;    /* mean of the exponential inter-arrival time */
+    nsec_t exec_time;
+    int jobs;
+    nsec_t resp_sum;
+    nsec_t resp_min;
+    nsec_t resp_max;
+} a_param;
+
+typedef struct aperiodic_job {
+    nsec_t arrival;
+    nsec_t deadline;
+    nsec_t exec_time;
+    int source;
+} a_job;
+
+/* statistics of a task as returned by stats_get */
+typedef struct stats_param {
+    char name[20];
+    int jobs;
+    int missed;
+    double miss_ratio;
+    nsec_t consumed;
+    double cpu;             /* share of one core since the start */
+    t_stat jitter;
+    t_stat latency;
+    t_stat response;
+    t_stat lateness;
+} t_stats;
+
+/* Total Bandwidth Server: the k-th aperiodic job gets the deadline
+ * d_k = max(r_k, d_k-1) + C_k / U_s and is served FIFO (deadlines grow
+ * with arrival order) by tAperiodic at the EDF rank of that deadline.
+ * The scheduler appends at tail, the server task advances head. */
+typedef struct server_param {
+    double util;
+    a_param* source;
+    int source_cnt;
+    a_job queue[SERVER_QUEUE];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    unsigned int seen_head; /* head as last seen by the scheduler */
+    nsec_t last_deadline;
+    int overflow;
+    q_param task;           /* the server in the active list */
+    nsec_t sim_consumed;    /* simulation: progress of the head job */
+    SEM_ID sem;
+    WHEEL_TIMER* timer;     /* scheduler timer, poked on job completion */
+} t_server;
+
+/* binary min-heap of pending tasks, keyed on the next event time
+ * (the absolute deadline of an active job, else the next release) */
+typedef struct task_heap {
+    q_param** node;
+    int size;
+} t_heap;
+
+/* scheduler state passed to the timer handler */
+typedef struct sched_param {
+    q_param* tasks;
+    q_param* arrivals;
+    t_heap heap;
+    q_param** active;       /* active jobs sorted by absolute deadline */
+    int active_cnt;
+    q_param** moved;        /* jobs whose rank left their priority behind */
+    int moved_cnt;
+    t_server* server;
+    WHEEL_TIMER timer;      /* next event, on the wheel of its core */
+} t_sched;
+
+/* set of admitted tasks; the utilisation is kept up to date on every add
+ * and remove so that implicit-deadline sets are checked in O(1). A set
+ * with more than one core is scheduled by global EDF and checked with
+ * the density bound instead of the uniprocessor tests */
+typedef struct admission_param {
+    t_param** task;
+    int cnt;
+    int cores;
+    double util;
+    double server_util;     /* aperiodic server bandwidth, part of util */
+    double density;         /* sum of C / min(D, T) */
+    int constrained;        /* number of tasks with D < T */
+    nsec_t fail_time;       /* where the demand test failed */
+} t_admit;
+
 /* task IDs */
-int tidTimerMux;
+int tidAperiodic;
+
+/* the task set, for the statistics queries */
+t_param* stats_tasks;
+int stats_task_cnt;
+
+/* busy loop iterations per millisecond of execution */
+long burn_per_ms = 0;
+
+/* virtual time, instead of the clock, in simulation mode */
+bool simulated = false;
+nsec_t sim_now = 0;
+
+const char* const ev_formats[EV_CNT] = {
+    [EV_CLOCK_ERROR] = "scheduler   | clock_gettime\n",
+    [EV_TIMER_SET]   = "scheduler   | timer set to %d.%06ds\n",
+    [EV_TIMER_ERROR] = "scheduler   | set_timer\n",
+    [EV_IN_TIME]     = "scheduler   | task (%s) executed in time\n",
+    [EV_MISSED]      = "scheduler   | task (%s) missed deadline\n",
+    [EV_SKIPPED]     = "scheduler   | task (%s) release skipped\n",
+    [EV_ACTIVATED]   = "scheduler   | task (%s) activated\n",
+    [EV_AP_DROPPED]  = "scheduler   | aperiodic job of source %d dropped\n",
+    [EV_AP_ARRIVED]  = "scheduler   | aperiodic job of source %d arrived, deadline %d.%06ds\n",
+    [EV_AP_DONE]     = "tAperiodic | job of source %d done, response %lldus%s\n",
+    [EV_STARTED]     = "%s | execution started\n",
+    [EV_OVERRUN]     = "%s | budget overrun\n",
+    [EV_ABORTED]     = "%s | execution aborted\n",
+    [EV_FINISHED]    = "%s | execution finished\n",
+};
+
+/* timeline: a slice per job on the track of its task */
+const TRACE_SPAN ev_spans[EV_CNT] = {
+    [EV_CLOCK_ERROR] = { 'i', -1, "scheduler",  "clock error" },
+    [EV_TIMER_SET]   = { 'i', -1, "scheduler",  "timer set" },
+    [EV_TIMER_ERROR] = { 'i', -1, "scheduler",  "timer error" },
+    [EV_IN_TIME]     = { 'i',  0, NULL,         "in time" },
+    [EV_MISSED]      = { 'i',  0, NULL,         "missed deadline" },
+    [EV_SKIPPED]     = { 'i',  0, NULL,         "release skipped" },
+    [EV_ACTIVATED]   = { 'i',  0, NULL,         "activated" },
+    [EV_AP_DROPPED]  = { 'i', -1, "tAperiodic", "dropped" },
+    [EV_AP_ARRIVED]  = { 'i', -1, "tAperiodic", "arrived" },
+    [EV_AP_DONE]     = { 'i', -1, "tAperiodic", "done" },
+    [EV_STARTED]     = { 'B',  0, NULL,         "job" },
+    [EV_OVERRUN]     = { 'i',  0, NULL,         "budget overrun" },
+    [EV_ABORTED]     = { 'E',  0, NULL,         "job" },
+    [EV_FINISHED]    = { 'E',  0, NULL,         "job" },
+};
 
 /* function declarations */
-void timerMux(t_param*, int);
-void scheduler(timer_t, q_param*);
-void periodic(int);
-void print_log_prefix(int);
+void run_tasks(t_param*, int, t_server*, int, int, int);
+STATUS timer_mux_start(t_sched*, WHEEL_ID, t_param*, int, t_server*, int);
+STATUS sched_init(t_sched*, t_param*, int, t_server*, int);
+void scheduler(WHEEL_TIMER*, t_sched*);
+void schedule_events(t_sched*, nsec_t);
+void server_arrival(t_sched*, q_param*);
+void server_update(t_sched*);
+void server_poke(t_server*);
+void server_done(t_server*, nsec_t);
+void aperiodic(t_server*);
+nsec_t random_exp(nsec_t);
+bool active_before(q_param*, q_param*);
+void active_insert(t_sched*, q_param*);
+void active_remove(t_sched*, q_param*);
+void active_move(t_sched*, q_param*);
+void active_reprio(t_sched*, int, int);
+void active_flush(t_sched*);
+void periodic(t_param*);
+void job_start(t_param*, unsigned int, nsec_t);
+bool job_overrun(t_param*);
+void job_finish(t_param*, unsigned int, nsec_t, nsec_t);
+void simulate(t_param*, int, t_server*, int, int, nsec_t);
+int  sim_pick(t_sched*, int, q_param**);
+bool sim_ready(t_sched*, q_param*);
+nsec_t sim_left(q_param*, t_server*);
+void sim_step(t_sched*, q_param*, t_server*, nsec_t);
+void sim_finish(t_param*);
+void log_prefix(FILE*, const TRACE_REC*);
+long long sim_clock(void);
+void burn_calibrate(void);
+void burn_loop(long);
+void burn(nsec_t);
+nsec_t thread_cpu_ns(void);
+nsec_t timespec_to_ns(const struct timespec*);
+void stat_add(t_stat*, nsec_t);
+nsec_t stat_avg(const t_stat*);
+STATUS stats_get(int, t_stats*);
+void stats_show(void);
+void ns_to_timespec(nsec_t, struct timespec*);
+void admit_init(t_admit*, int, int);
+int  admit_task(t_admit*, t_param*);
+int  admit_server(t_admit*, double);
+void admit_remove(t_admit*, t_param*);
+bool density_test(t_admit*);
+bool demand_test(t_admit*);
+nsec_t demand(t_admit*, nsec_t);
+nsec_t last_deadline_before(t_admit*, nsec_t);
+nsec_t busy_period(t_admit*);
+int  partition_task(t_admit*, int, int, t_param*);
+bool partition_repack(t_admit*, int, int, t_param*, int);
+int  util_cmp(const void*, const void*);
+cpuset_t core_set(int, int);
+int  heap_cmp(q_param*, q_param*);
+void heap_swap(t_heap*, int, int);
+void heap_sift_up(t_heap*, int);
+void heap_sift_down(t_heap*, int);
+void heap_push(t_heap*, q_param*);
 
 
 /*************************************************************************/
@@ -70,43 +364,342 @@ void print_log_prefix(int);
 /*************************************************************************/
 
 int main(void) {
-    struct  timespec mytime;
     int     task_cnt = 0;
     int     nseconds = 0;
-    int     i;
-    t_param t_params[MAX_PERIODIC];
-	char t_name[20];
+    int     i, c;
+    int     cores = 0;
+    int     mode = -1;
+    int     sets;
+    int     source_cnt = -1;
+    int     server_pct = 0;
+    int     max_pct;
+    int     jobs, late, core_tasks, core_jobs, core_late;
+    int     run_mode = -1;
+    int     max_seconds, max_cores;
+    int     seed = -1;
+    int     print_trace = -1;
+    int     timeline = -1;
+    long long period_us, exec_us, deadline_us, arrival_us, actual_us;
+    t_param* t_params;
+    t_admit admit[MAX_CORES];
+    static t_server server;
+    a_param* source;
 
-    /* get the simulation time */ 
+    /* run the tasks in real time or simulate them in virtual time */
     printf("\n\n");
-    while ((nseconds < 1) || (nseconds > MAX_SECONDS)) {
-        printf("Enter overall simulation time [1-%d s]: ", MAX_SECONDS);
+    while ((run_mode < 0) || (run_mode > 1)) {
+        printf("Enter the run mode [0 real time, 1 simulated]: ");
+        scanf("%d", &run_mode);
+    };
+    simulated = (run_mode == 1);
+    if (simulated) {
+        while (seed < 0) {
+            printf("Enter the random seed [>=0]: ");
+            scanf("%d", &seed);
+        };
+        while ((print_trace < 0) || (print_trace > 1)) {
+            printf("Print the schedule trace [0 no, 1 yes]: ");
+            scanf("%d", &print_trace);
+        };
+    }
+    while ((timeline < 0) || (timeline > 1)) {
+        printf("Export the schedule timeline to "TIMELINE" [0 no, 1 yes]: ");
+        scanf("%d", &timeline);
+    };
+    max_seconds = simulated ? MAX_SIM_SECONDS : MAX_SECONDS;
+    max_cores = simulated ? MAX_CORES : (int)vxCpuConfiguredGet();
+
+    /* get the simulation time */ 
+    while ((nseconds < 1) || (nseconds > max_seconds)) {
+        printf("Enter overall simulation time [1-%d s]: ", max_seconds);
         scanf("%d", &nseconds);
     };
     printf("Simulating for %d seconds.\n\n", nseconds);
 
     /* get the number of tasks */
-    while ((task_cnt < 1) || (task_cnt > MAX_PERIODIC)) {
-        printf("Enter the number of periodic tasks to be scheduled [1-%d]: ", MAX_PERIODIC);
+    while (task_cnt < 1) {
+        printf("Enter the number of periodic tasks to be scheduled [>=1]: ");
         scanf("%d", &task_cnt);
     };
     printf("Number of periodic tasks set to %d.\n\n", task_cnt);
 
-    for (i = 0; i < task_cnt; i++){
-        // get period of task i
-        while ((t_params[i].period < 1) || (t_params[i].period > MAX_PERIOD)) {
-            printf("Enter the period of task %d [1-%d]s: ", i+1, MAX_PERIOD);
-            scanf("%d", &t_params[i].period);
+    /* get the number of cores and how the tasks are spread over them */
+    while ((cores < 1) || (cores > max_cores) || (cores > MAX_CORES)) {
+        printf("Enter the number of cores [1-%d]: ", max_cores);
+        scanf("%d", &cores);
+    };
+    while ((mode < MODE_PARTITIONED_FF) || (mode > MODE_GLOBAL)) {
+        printf("Enter the multicore mode "
+                "[0 partitioned first-fit, 1 partitioned worst-fit, 2 global]: ");
+        scanf("%d", &mode);
+    };
+    printf("Scheduling on %d cores, %s EDF.\n\n", cores,
+            (mode == MODE_GLOBAL) ? "global" : "partitioned");
+
+    /* partitioned: one uniprocessor set per core, global: one set for all */
+    sets = (mode == MODE_GLOBAL) ? 1 : cores;
+    t_params = calloc(task_cnt, sizeof(t_param));
+    for (c = 0; c < sets; c++)
+        admit_init(&admit[c], task_cnt, (mode == MODE_GLOBAL) ? cores : 1);
+    for (c = 0; c < sets && admit[c].task != NULL; c++);
+    if (t_params == NULL || c < sets) {
+        printf("Error calloc\n");
+        return(-1);
+    }
+
+    for (i = 0; i < task_cnt; i++) {
+        /* ask again until the task is admitted */
+        do {
+            // get period of task i
+            period_us = 0;
+            while ((period_us < 1) || (period_us > MAX_PERIOD)) {
+                printf("Enter the period of task %d [1-%lld us]: ", i+1, MAX_PERIOD);
+                scanf("%lld", &period_us);
+            };
+            t_params[i].period = period_us * NSEC_PER_USEC;
+            printf("Period of task %d set to %lldus.\n\n", i+1, period_us);
+
+            // get execution time of task i
+            exec_us = 0;
+            while ((exec_us < 1) || (exec_us > period_us)) {
+                printf("Enter the execution time of task %d [1-%lld us]: ", i+1, period_us);
+                scanf("%lld", &exec_us);
+            };
+            t_params[i].exec_time = exec_us * NSEC_PER_USEC;
+            printf("Execution time of task %d set to %lldus.\n\n", i+1, exec_us);
+
+            // get relative deadline of task i (constrained: D <= T)
+            deadline_us = 0;
+            while ((deadline_us < exec_us) || (deadline_us > period_us)
+                    || (deadline_us > MAX_DEADLINE)) {
+                printf("Enter the relative deadline of task %d [%lld-%lld us]: ",
+                        i+1, exec_us, period_us);
+                scanf("%lld", &deadline_us);
+            };
+            t_params[i].deadline = deadline_us * NSEC_PER_USEC;
+            printf("Deadline of task %d set to %lldus.\n\n", i+1, deadline_us);
+
+            // get the execution time the jobs really need (overrun above budget)
+            actual_us = 0;
+            while ((actual_us < 1) || (actual_us > MAX_PERIOD)) {
+                printf("Enter the actual execution time of task %d [1-%lld us]: ",
+                        i+1, MAX_PERIOD);
+                scanf("%lld", &actual_us);
+            };
+            t_params[i].actual_time = actual_us * NSEC_PER_USEC;
+            printf("Actual execution time of task %d set to %lldus.\n\n", i+1, actual_us);
+
+            // get the overrun policy of task i
+            t_params[i].policy = -1;
+            while ((t_params[i].policy < POLICY_SKIP)
+                    || (t_params[i].policy > POLICY_CONTINUE)) {
+                printf("Enter the overrun policy of task %d "
+                        "[0 skip next, 1 abort, 2 demote, 3 continue]: ", i+1);
+                scanf("%d", &t_params[i].policy);
+            };
+
+            // admission control: the task set must stay schedulable
+            if (mode != MODE_GLOBAL) {
+                c = partition_task(admit, cores, mode, &t_params[i]);
+                if (c >= 0) {
+                    printf("Task %d admitted on core %d, utilisation %.4f.\n\n",
+                            i+1, c, admit[c].util);
+                    break;
+                }
+                printf("Task %d rejected: it fits on none of the %d cores.\n\n",
+                        i+1, cores);
+                continue;
+            }
+            t_params[i].core = -1;
+            switch (admit_task(&admit[0], &t_params[i])) {
+                case ADMIT_OK:
+                    printf("Task %d admitted, utilisation %.4f.\n\n", i+1, admit[0].util);
+                    break;
+                case ADMIT_UTIL:
+                    printf("Task %d rejected: utilisation would exceed %d.\n\n",
+                            i+1, cores);
+                    continue;
+                case ADMIT_DEMAND:
+                    printf("Task %d rejected: processor demand exceeds supply at %lldus.\n\n",
+                            i+1, admit[0].fail_time / NSEC_PER_USEC);
+                    continue;
+                case ADMIT_DENSITY:
+                    printf("Task %d rejected: density bound for %d cores exceeded.\n\n",
+                            i+1, cores);
+                    continue;
+            }
+            break;
+        } while (1);
+    }
+
+    /* the whole set is known now: bin-pack it again in decreasing order */
+    if (mode != MODE_GLOBAL && cores > 1) {
+        if (partition_repack(admit, cores, mode, t_params, task_cnt))
+            printf("Tasks repacked by decreasing utilisation.\n");
+        else
+            printf("Repacking failed, tasks keep their cores.\n");
+        for (c = 0; c < cores; c++)
+            printf("Core %d: %d tasks, utilisation %.4f.\n", c, admit[c].cnt,
+                    admit[c].util);
+        printf("\n");
+    }
+
+    /* get the aperiodic sources and the server bandwidth */
+    while ((source_cnt < 0) || (source_cnt > MAX_APERIODIC)) {
+        printf("Enter the number of aperiodic sources [0-%d]: ", MAX_APERIODIC);
+        scanf("%d", &source_cnt);
+    };
+    printf("Number of aperiodic sources set to %d.\n\n", source_cnt);
+
+    /* the server is bound to core 0 when partitioned */
+    max_pct = (int)((admit[0].cores - admit[0].util) * 100);
+    if (max_pct > 100)
+        max_pct = 100;
+    if (source_cnt > 0 && max_pct < 1) {
+        printf("No bandwidth left for an aperiodic server, "
+                "the sources are dropped.\n\n");
+        source_cnt = 0;
+    }
+    while (source_cnt > 0) {
+        printf("Enter the aperiodic server bandwidth [1-%d %%, 0 none]: ",
+                max_pct);
+        if (scanf("%d", &server_pct) != 1) {
+            printf("\nNo server bandwidth given.\n");
+            return(-1);
+        }
+        if (server_pct == 0) {
+            printf("No aperiodic server, the sources are dropped.\n\n");
+            source_cnt = 0;
+            break;
+        }
+        if (server_pct < 1 || server_pct > 100)
+            continue;
+        if (admit_server(&admit[0], server_pct / 100.0) == ADMIT_OK)
+            break;
+        printf("Server bandwidth %d%% rejected.\n\n", server_pct);
+    };
+    server.util = admit[0].server_util;
+    server.source_cnt = source_cnt;
+    server.source = source = calloc(source_cnt ? source_cnt : 1, sizeof(a_param));
+
+    for (i = 0; i < source_cnt; i++) {
+        // get mean inter-arrival time of source i
+        arrival_us = 0;
+        while ((arrival_us < 1) || (arrival_us > MAX_ARRIVAL)) {
+            printf("Enter the mean inter-arrival time of source %d [1-%lld us]: ",
+                    i+1, MAX_ARRIVAL);
+            scanf("%lld", &arrival_us);
         };
-        printf("Period of task %d set to %d.\n\n", i+1, t_params[i].period);
+        source[i].interarrival = arrival_us * NSEC_PER_USEC;
 
-        // get execution time of task i
-        while ((t_params[i].exec_time < 1) || (t_params[i].exec_time > t_params[i].period)) {
-            printf("Enter the execution time of task %d [1-%d]s: ", i+1, t_params[i].period);
-            scanf("%d", &t_params[i].exec_time);
+        // get execution time of a job of source i
+        exec_us = 0;
+        while ((exec_us < 1) || (exec_us > MAX_ARRIVAL)) {
+            printf("Enter the execution time of source %d [1-%lld us]: ",
+                    i+1, MAX_ARRIVAL);
+            scanf("%lld", &exec_us);
         };
-        printf("Execution time of task %d set to %d.\n\n", i+1, t_params[i].exec_time);
+        source[i].exec_time = exec_us * NSEC_PER_USEC;
+        printf("Source %d: mean inter-arrival %lldus, execution time %lldus.\n\n",
+                i+1, arrival_us, exec_us);
+    }
+    for (c = 0; c < sets; c++)
+        free(admit[c].task);
+
+    for (i=0; i<task_cnt; i++) {
+        sprintf(t_params[i].name, "tPeriodic_%d", i);
+        t_params[i].abort_job = (unsigned int)-1;
+    }
+    stats_tasks = t_params;
+    stats_task_cnt = task_cnt;
+    /* the log goes through the trace rings, stamped with virtual time
+     * when simulated */
+    if (simulated)
+        traceClockSet(sim_clock);
+    if (timeline && traceExport(TIMELINE, ev_spans) == ERROR)
+        printf("Error traceExport\n");
+    traceEnable(!simulated || print_trace || timeline);
+    if (traceStart(ev_formats, EV_CNT, log_prefix,
+                (simulated && !print_trace) ? NULL : stdout) == ERROR)
+        printf("Error traceStart\n");
+    if (simulated) {
+        srand(seed);
+        simulate(t_params, task_cnt, &server, cores, mode, nseconds * NSEC_PER_SEC);
     }
+    else
+        run_tasks(t_params, task_cnt, &server, cores, mode, nseconds);
+    traceStop();
+
+    /* overrun handling */
+    for (i = 0; i < task_cnt; i++) {
+        printf("Task %d: %u jobs, %d overruns, %d aborted, %d skipped, %d late, "
+                "max tardiness %lldus.\n", i+1, t_params[i].finished,
+                t_params[i].overruns, t_params[i].aborted, t_params[i].skipped,
+                t_params[i].late, t_params[i].tardiness_max / NSEC_PER_USEC);
+    }
+    stats_show();
+
+    /* aperiodic response times */
+    for (i = 0; i < source_cnt; i++) {
+        if (source[i].jobs == 0) {
+            printf("Source %d: no job completed.\n", i+1);
+            continue;
+        }
+        printf("Source %d: %d jobs, response time min %lldus avg %lldus max %lldus.\n",
+                i+1, source[i].jobs, source[i].resp_min / NSEC_PER_USEC,
+                source[i].resp_sum / source[i].jobs / NSEC_PER_USEC,
+                source[i].resp_max / NSEC_PER_USEC);
+    }
+    if (server.overflow > 0)
+        printf("Server queue overflowed, %d jobs dropped.\n", server.overflow);
+
+    /* throughput and miss ratio per core, to compare modes and core counts */
+    jobs = late = 0;
+    for (c = 0; c < sets; c++) {
+        core_tasks = core_jobs = core_late = 0;
+        for (i = 0; i < task_cnt; i++) {
+            if (mode != MODE_GLOBAL && t_params[i].core != c)
+                continue;
+            core_tasks++;
+            core_jobs += t_params[i].finished;
+            core_late += t_params[i].late;
+        }
+        if (mode != MODE_GLOBAL)
+            printf("Core %d: ", c);
+        else
+            printf("Cores 0-%d: ", cores-1);
+        printf("%d tasks, %.1f jobs/s, miss ratio %.4f.\n", core_tasks,
+                (double)core_jobs / nseconds,
+                core_jobs ? (double)core_late / core_jobs : 0.0);
+        jobs += core_jobs;
+        late += core_late;
+    }
+    printf("Total: %.1f jobs/s, miss ratio %.4f.\n", (double)jobs / nseconds,
+            jobs ? (double)late / jobs : 0.0);
+    free(source);
+    free(t_params);
+
+    printf("Exiting. \n\n");
+    return(0);
+}
+
+
+/*************************************************************************/
+/*  real-time run                                                        */
+/*                                                                       */
+/*************************************************************************/
+
+void run_tasks(t_param* t_params, int task_cnt, t_server* server, int cores,
+        int mode, int nseconds) {
+    struct  timespec mytime;
+    int     i, c;
+    int     sets = (mode == MODE_GLOBAL) ? 1 : cores;
+	char t_name[20];
+    WHEEL_ID wheels[MAX_CORES];
+    t_sched sched[MAX_CORES];
+
+    /* measure the speed of the busy loop emulating execution */
+    burn_calibrate();
 
     /* set clock to start at 0 */
     mytime.tv_sec  = 0;
@@ -118,70 +711,449 @@ int main(void) {
         printf("Current time set to %d sec %d ns \n\n",
                 (int) mytime.tv_sec, (int)mytime.tv_nsec);
 
-    /* spawn (create and start) timer task */
-    tidTimerMux = taskSpawn("tTimerMux", 101, 0, STACK_SIZE,
-        (FUNCPTR)timerMux, (int)t_params, task_cnt, 0, 0, 0, 0, 0, 0, 0, 0);
-
-    /* create periodic tasks */
+    /* spawn periodic tasks (before the timer task reads their IDs), each
+     * one blocks until its first release */
     for (i=0; i<task_cnt; i++) {
-		sprintf(t_name, "tPeriodic_%d", i);
-        t_params[i].id = taskCreate(t_name, 255, 0, STACK_SIZE,
-            (FUNCPTR)periodic, t_params[i].exec_time, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        t_params[i].release_sem = semCCreate(SEM_Q_FIFO, 0);
+        t_params[i].id = taskCreate(t_params[i].name, BG_PRIO, 0, STACK_SIZE,
+            (FUNCPTR)periodic, (_Vx_usr_arg_t)&t_params[i], 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        if (taskCpuAffinitySet(t_params[i].id, core_set(t_params[i].core, cores)) == ERROR)
+            printf("Warning: %s not bound to its cores\n", t_params[i].name);
+        taskActivate(t_params[i].id);
     }
 
-    /* run for given simulation time */
-    taskDelay(nseconds*60);
+    /* spawn the aperiodic server, it blocks until the first arrival */
+    if (server->source_cnt > 0) {
+        server->sem = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+        tidAperiodic = taskCreate("tAperiodic", 255, 0, STACK_SIZE,
+            (FUNCPTR)aperiodic, (_Vx_usr_arg_t)server, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        if (taskCpuAffinitySet(tidAperiodic,
+                    core_set((mode == MODE_GLOBAL) ? -1 : 0, cores)) == ERROR)
+            printf("Warning: tAperiodic not bound to its cores\n");
+        taskActivate(tidAperiodic);
+    }
 
-    /* create periodic tasks */
+    /* one timer wheel per core, or a single one for global EDF; the
+     * first one also serves the aperiodic arrivals */
+    for (c = 0; c < sets; c++) {
+        sprintf(t_name, "tTimerMux_%d", c);
+        wheels[c] = wheelCreate(t_name, 101,
+                core_set((mode == MODE_GLOBAL) ? -1 : c, cores));
+        if (wheels[c] == NULL) {
+            printf("Warning: %s not bound to its cores\n", t_name);
+            wheels[c] = wheelCreate(t_name, 101, 0);
+        }
+        if (wheels[c] == NULL
+                || timer_mux_start(&sched[c], wheels[c], t_params, task_cnt,
+                    (c == 0) ? server : NULL, (mode == MODE_GLOBAL) ? -1 : c) == ERROR)
+            printf("Error: %s not started\n", t_name);
+    }
+
+    /* run for given simulation time, on the clock set to 0 above */
+    delayUntilRt(nseconds * NSEC_PER_SEC, NULL);
+
+    /* delete periodic tasks */
+    traceFlush();
+    for (c = 0; c < sets; c++) {
+        wheelShow(wheels[c]);
+        wheelDelete(wheels[c]);
+    }
     for (i=0; i<task_cnt; i++) {
         taskDelete(t_params[i].id);
+        semDelete(t_params[i].release_sem);
+    }
+    if (server->source_cnt > 0) {
+        taskDelete(tidAperiodic);
+        semDelete(server->sem);
     }
-    taskDelete(tidTimerMux);
+}
 
-    printf("Exiting. \n\n");
-    return(0);
+
+/*************************************************************************/
+/*  admission control                                                    */
+/*                                                                       */
+/*  EDF is feasible for implicit deadlines iff U <= 1. With constrained  */
+/*  deadlines the processor demand h(t) must not exceed t for any        */
+/*  absolute deadline t up to the bound L; this is checked with Quick    */
+/*  Processor-demand Analysis (Zhang & Burns), which only visits a few   */
+/*  points instead of every deadline up to L.                            */
+/*                                                                       */
+/*  Global EDF on m cores uses the sufficient density bound of Goossens, */
+/*  Funk and Baruah: sum(delta) <= m - (m - 1) max(delta), delta = C/D.  */
+/*                                                                       */
+/*************************************************************************/
+
+void admit_init(t_admit* admit, int task_cnt, int cores) {
+    admit->task = calloc(task_cnt, sizeof(t_param*));
+    admit->cnt = 0;
+    admit->cores = cores;
+    admit->util = 0;
+    admit->server_util = 0;
+    admit->density = 0;
+    admit->constrained = 0;
+    admit->fail_time = 0;
+}
+
+int admit_task(t_admit* admit, t_param* task) {
+    admit->task[admit->cnt++] = task;
+    admit->util += (double)task->exec_time / task->period;
+    admit->density += (double)task->exec_time / task->deadline;
+    if (task->deadline < task->period)
+        admit->constrained++;
+
+    if (admit->util > admit->cores + 1e-9) {
+        admit_remove(admit, task);
+        return ADMIT_UTIL;
+    }
+    if (admit->cores > 1 && !density_test(admit)) {
+        admit_remove(admit, task);
+        return ADMIT_DENSITY;
+    }
+    if (admit->cores == 1 && admit->constrained > 0 && !demand_test(admit)) {
+        admit_remove(admit, task);
+        return ADMIT_DEMAND;
+    }
+    return ADMIT_OK;
+}
+
+/* the server demands at most U_s * t in any interval of length t */
+int admit_server(t_admit* admit, double util) {
+    int rc = ADMIT_OK;
+
+    admit->util += util;
+    admit->server_util = util;
+    if (admit->util > admit->cores + 1e-9)
+        rc = ADMIT_UTIL;
+    else if (admit->cores > 1 && !density_test(admit))
+        rc = ADMIT_DENSITY;
+    else if (admit->cores == 1 && admit->constrained > 0 && !demand_test(admit))
+        rc = ADMIT_DEMAND;
+    if (rc != ADMIT_OK) {
+        admit->util -= util;
+        admit->server_util = 0;
+    }
+    return rc;
+}
+
+void admit_remove(t_admit* admit, t_param* task) {
+    int i;
+
+    for (i = admit->cnt - 1; i >= 0; i--) {
+        if (admit->task[i] == task) {
+            admit->task[i] = admit->task[--admit->cnt];
+            admit->util -= (double)task->exec_time / task->period;
+            admit->density -= (double)task->exec_time / task->deadline;
+            if (task->deadline < task->period)
+                admit->constrained--;
+            return;
+        }
+    }
+}
+
+/* the server counts as a task of density U_s */
+bool density_test(t_admit* admit) {
+    int i;
+    double d, d_max = admit->server_util;
+
+    for (i = 0; i < admit->cnt; i++) {
+        d = (double)admit->task[i]->exec_time / admit->task[i]->deadline;
+        if (d > d_max)
+            d_max = d;
+    }
+    return admit->density + admit->server_util
+        <= admit->cores - (admit->cores - 1) * d_max + 1e-9;
+}
+
+bool demand_test(t_admit* admit) {
+    int i;
+    t_param* task;
+    nsec_t d_min, d_max, t, h, limit;
+    double la = 0;
+
+    d_min = d_max = admit->task[0]->deadline;
+    for (i = 0; i < admit->cnt; i++) {
+        task = admit->task[i];
+        if (task->deadline < d_min)
+            d_min = task->deadline;
+        if (task->deadline > d_max)
+            d_max = task->deadline;
+        la += (double)(task->period - task->deadline) * task->exec_time
+            / task->period;
+    }
+
+    /* the demand only needs checking up to the synchronous busy period and,
+     * for U < 1, up to max(D_max, sum((T_i - D_i) U_i) / (1 - U)) */
+    limit = busy_period(admit);
+    if (admit->util < 1.0 - 1e-9) {
+        la = la / (1.0 - admit->util);
+        if (la < d_max)
+            la = d_max;
+        if (limit < 0 || la < limit)
+            limit = (nsec_t)la;
+    }
+    else if (limit < 0) {
+        admit->fail_time = 0;
+        return false;
+    }
+
+    t = last_deadline_before(admit, limit + 1);
+    h = demand(admit, t);
+    while (h <= t && h > d_min) {
+        t = (h < t) ? h : last_deadline_before(admit, t);
+        h = demand(admit, t);
+    }
+    admit->fail_time = t;
+    return h <= d_min;
+}
+
+/* processor demand of the jobs released and due within [0, t], stretched by
+ * the share U_s the server takes: h(t) + U_s t <= t iff h(t) / (1 - U_s) <= t,
+ * which keeps the steps at the deadlines QPA walks back through */
+nsec_t demand(t_admit* admit, nsec_t t) {
+    int i;
+    t_param* task;
+    nsec_t h = 0;
+
+    for (i = 0; i < admit->cnt; i++) {
+        task = admit->task[i];
+        if (t >= task->deadline)
+            h += ((t - task->deadline) / task->period + 1) * task->exec_time;
+    }
+    if (admit->server_util <= 0)
+        return h;
+    if (admit->server_util >= 1.0 - 1e-9)
+        return h ? LLONG_MAX : 0;
+    return (nsec_t)ceil(h / (1.0 - admit->server_util));
+}
+
+/* latest absolute deadline strictly before t, 0 if there is none */
+nsec_t last_deadline_before(t_admit* admit, nsec_t t) {
+    int i;
+    t_param* task;
+    nsec_t d, latest = 0;
+
+    for (i = 0; i < admit->cnt; i++) {
+        task = admit->task[i];
+        if (t > task->deadline) {
+            d = (t - task->deadline - 1) / task->period * task->period
+                + task->deadline;
+            if (d > latest)
+                latest = d;
+        }
+    }
+    return latest;
+}
+
+/* length of the synchronous busy period: w = sum(ceil(w / T_i) C_i) + U_s w,
+ * -1 if it does not converge */
+nsec_t busy_period(t_admit* admit) {
+    int i, iter;
+    t_param* task;
+    nsec_t w = 0, next;
+
+    for (i = 0; i < admit->cnt; i++)
+        w += admit->task[i]->exec_time;
+    for (iter = 0; iter < MAX_BUSY_ITER; iter++) {
+        next = (nsec_t)ceil(admit->server_util * w);
+        for (i = 0; i < admit->cnt; i++) {
+            task = admit->task[i];
+            next += (w + task->period - 1) / task->period * task->exec_time;
+        }
+        if (next <= w)
+            return w;
+        w = next;
+    }
+    return -1;
 }
 
 
 /*************************************************************************/
-/*  multiplexed timer task                                               */
+/*  core partitioning                                                    */
+/*                                                                       */
+/*  partitioned EDF binds every task to one core, each core being an     */
+/*  independent uniprocessor EDF scheduler with its own admission set    */
 /*                                                                       */
 /*************************************************************************/
 
-void timerMux(t_param* t_params, int task_cnt) {
-	int i;
-	timer_t ptimer;
-	struct itimerspec intervaltimer;
-    q_param pending_tasks[MAX_PERIODIC];
+/* bind a task to the first core it fits on (first-fit) or try the cores
+ * from the least loaded on (worst-fit); returns the core, -1 if none fits */
+int partition_task(t_admit* admit, int cores, int mode, t_param* task) {
+    int order[MAX_CORES];
+    int i, j;
+
+    for (i = 0; i < cores; i++) {
+        j = i;
+        if (mode == MODE_PARTITIONED_WF) {
+            while (j > 0 && admit[order[j-1]].util > admit[i].util) {
+                order[j] = order[j-1];
+                j--;
+            }
+        }
+        order[j] = i;
+    }
+    for (i = 0; i < cores; i++) {
+        if (admit_task(&admit[order[i]], task) == ADMIT_OK) {
+            task->core = order[i];
+            return order[i];
+        }
+    }
+    task->core = -1;
+    return -1;
+}
 
-	/* create timer */
-	if ( timer_create(CLOCK_REALTIME, NULL, &ptimer) == ERROR)
-		printf("Error create_timer\n");
+/* the tasks are admitted online as they are entered; once the set is
+ * complete it is packed again by decreasing utilisation (FFD or WFD),
+ * the online assignment is kept if that fails */
+bool partition_repack(t_admit* admit, int cores, int mode, t_param* t_params,
+        int task_cnt) {
+    t_admit trial[MAX_CORES];
+    t_param** order;
+    int* core;
+    int i;
+    bool ok = true;
 
-    /* initialize pending_tasks array */
-    for (i=0; i<MAX_PERIODIC; i++) {
-        pending_tasks[i].status = (i < task_cnt) ? READY : WAITING;
-        pending_tasks[i].id = t_params[i].id;
-        pending_tasks[i].period = t_params[i].period;
-        pending_tasks[i].qt.tv_sec = 0;
-        pending_tasks[i].qt.tv_nsec = 1;
+    order = calloc(task_cnt, sizeof(t_param*));
+    core = calloc(task_cnt, sizeof(int));
+    for (i = 0; i < cores; i++) {
+        admit_init(&trial[i], task_cnt, 1);
+        if (trial[i].task == NULL)
+            ok = false;
     }
+    if (order == NULL || core == NULL)
+        ok = false;
 
-	/* connect timer to timer handler routine */
-	if ( timer_connect(ptimer, (VOIDFUNCPTR)scheduler, (int)pending_tasks) == ERROR )
-		printf("Error connect_timer\n");
+    if (ok) {
+        for (i = 0; i < task_cnt; i++) {
+            order[i] = &t_params[i];
+            core[i] = t_params[i].core;
+        }
+        qsort(order, task_cnt, sizeof(t_param*), util_cmp);
+        for (i = 0; i < task_cnt && ok; i++)
+            ok = partition_task(trial, cores, mode, order[i]) >= 0;
+        if (!ok) {
+            for (i = 0; i < task_cnt; i++)
+                t_params[i].core = core[i];
+        }
+    }
+    for (i = 0; i < cores; i++) {
+        if (ok) {
+            free(admit[i].task);
+            admit[i] = trial[i];
+        }
+        else
+            free(trial[i].task);
+    }
+    free(order);
+    free(core);
+    return ok;
+}
+
+/* decreasing utilisation, equal ones in input order */
+int util_cmp(const void* a, const void* b) {
+    t_param* ta = *(t_param* const*)a;
+    t_param* tb = *(t_param* const*)b;
+    double ua = (double)ta->exec_time / ta->period;
+    double ub = (double)tb->exec_time / tb->period;
+
+    if (ua != ub)
+        return (ua > ub) ? -1 : 1;
+    return (ta < tb) ? -1 : (ta > tb);
+}
+
+/* the given core, or the first cores of the machine for core -1 */
+cpuset_t core_set(int core, int cores) {
+    cpuset_t set;
+    int c;
+
+    CPUSET_ZERO(set);
+    if (core >= 0)
+        CPUSET_SET(set, core);
+    else
+        for (c = 0; c < cores; c++)
+            CPUSET_SET(set, c);
+    return set;
+}
 
-	/* set and arm timer */
-	intervaltimer.it_value.tv_sec = 0;
-	intervaltimer.it_value.tv_nsec = 1;
-	intervaltimer.it_interval.tv_sec = 0;
-	intervaltimer.it_interval.tv_nsec = 0;
 
-	if ( timer_settime(ptimer, TIMER_ABSTIME, &intervaltimer, NULL) == ERROR )
-		printf("Error set_timer\n");
+/*************************************************************************/
+/*  multiplexed timer                                                    */
+/*                                                                       */
+/*  one instance per core for partitioned EDF, handling the tasks bound  */
+/*  to that core, or a single one for all tasks (core -1); only the one  */
+/*  given the server handles aperiodic arrivals. Its timer runs on the   */
+/*  timer wheel of the core, at the priority of the wheel task           */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS timer_mux_start(t_sched* sched, WHEEL_ID wheel, t_param* t_params,
+        int task_cnt, t_server* server, int core) {
+    struct timespec mytime;
+
+    if (sched_init(sched, t_params, task_cnt, server, core) == ERROR) {
+        printf("Error calloc\n");
+        return ERROR;
+    }
+    if (server != NULL)
+        server->timer = &sched->timer;
 
-	/* idle loop */
-	while(1) pause();
+    /* first run right away, to release the tasks */
+    clock_gettime(CLOCK_REALTIME, &mytime);
+    wheelTimerInit(&sched->timer, wheel, (VOIDFUNCPTR)scheduler, (_Vx_usr_arg_t)sched);
+    return wheelTimerStart(&sched->timer, timespec_to_ns(&mytime), 0);
+}
+
+/* initialize pending_tasks array, the event heap and the active list */
+STATUS sched_init(t_sched* sched, t_param* t_params, int task_cnt,
+        t_server* server, int core) {
+	int i, n;
+	int source_cnt = (server != NULL) ? server->source_cnt : 0;
+    q_param* pending_tasks;
+    q_param* arrivals;
+
+    sched->tasks = pending_tasks = calloc(task_cnt, sizeof(q_param));
+    sched->arrivals = arrivals = calloc(source_cnt ? source_cnt : 1, sizeof(q_param));
+    sched->heap.node = calloc(task_cnt + source_cnt, sizeof(q_param*));
+    sched->heap.size = 0;
+    sched->active = calloc(task_cnt + 1, sizeof(q_param*));
+    sched->active_cnt = 0;
+    sched->moved = calloc(task_cnt + 1, sizeof(q_param*));
+    sched->moved_cnt = 0;
+    sched->server = server;
+    if (pending_tasks == NULL || arrivals == NULL || sched->heap.node == NULL
+            || sched->active == NULL || sched->moved == NULL)
+        return ERROR;
+    for (i=0, n=0; i<task_cnt; i++) {
+        if (core >= 0 && t_params[i].core != core)
+            continue;
+        pending_tasks[n].status = READY;
+        pending_tasks[n].id = t_params[i].id;
+        pending_tasks[n].period = t_params[i].period;
+        pending_tasks[n].deadline = t_params[i].deadline;
+        pending_tasks[n].param = &t_params[i];
+        pending_tasks[n].prio = 255;
+        pending_tasks[n].active_idx = -1;
+        pending_tasks[n].release = 0;
+        pending_tasks[n].qt = 0;
+        pending_tasks[n].type = TYPE_PERIODIC;
+        heap_push(&sched->heap, &pending_tasks[n]);
+        n++;
+    }
+
+    /* first arrival of each aperiodic source */
+    for (i=0; i<source_cnt; i++) {
+        arrivals[i].id = i;
+        arrivals[i].type = TYPE_ARRIVAL;
+        arrivals[i].active_idx = -1;
+        arrivals[i].qt = random_exp(server->source[i].interarrival);
+        heap_push(&sched->heap, &arrivals[i]);
+    }
+    if (server != NULL) {
+        server->task.id = tidAperiodic;
+        server->task.prio = 255;
+        server->task.active_idx = -1;
+        server->task.moved = false;
+    }
+    return OK;
 }
 
 
@@ -190,70 +1162,329 @@ void timerMux(t_param* t_params, int task_cnt) {
 /*                                                                       */
 /*************************************************************************/
 
-void scheduler(timer_t callingtimer, q_param* pending_tasks) {
-    int i, j, id, period;
-	struct itimerspec intervaltimer;
-
-    /* set priority of arrived task according to its deadline */
-    for (i=0; i<MAX_PERIODIC; i++) {
-        id = pending_tasks[i].id;
-        period = pending_tasks[i].period;
-        if (pending_tasks[i].status == READY) {
-            taskPrioritySet(id, MAX_PRIO + period);
-            /* activate the task */
-            taskActivate(id);
-            print_log_prefix(LOG_INFO);
-            printf("scheduler   | task (%s) activated\n", taskName(id));
-            pending_tasks[i].status = RUNNING;
-			/* set the new queue time */
-			pending_tasks[i].qt.tv_sec = pending_tasks[i].qt.tv_sec + period;
+void scheduler(WHEEL_TIMER* timer, t_sched* sched) {
+    struct timespec mytime;
+
+    if (clock_gettime(CLOCK_REALTIME, &mytime) == ERROR) {
+        TRACE(LOG_ERROR, EV_CLOCK_ERROR, 0);
+        return;
+    }
+    schedule_events(sched, timespec_to_ns(&mytime));
+
+    /* a core without tasks has nothing to wait for */
+    if (sched->heap.size == 0)
+        return;
+
+    /* get next queue time */
+    ns_to_timespec(sched->heap.node[0]->qt, &mytime);
+
+	TRACE(LOG_DEBUG, EV_TIMER_SET, mytime.tv_sec,
+            (int)(mytime.tv_nsec / NSEC_PER_USEC));
+
+	/* set and arm timer */
+	if (wheelTimerStart(timer, sched->heap.node[0]->qt, 0) == ERROR) {
+        TRACE(LOG_ERROR, EV_TIMER_ERROR, 0);
+    }
+
+    /* a job completed while the timer was re-armed: its poke was overwritten */
+    if (sched->server != NULL && sched->server->head != sched->server->seen_head)
+        server_poke(sched->server);
+}
+
+/* handle every deadline and release that has come by now, earliest first;
+ * several tasks released within the same timer expiry are handled
+ * together, deadlines before releases at equal times. Shared by the timer
+ * handler and the simulation, which only skips the kernel calls */
+void schedule_events(t_sched* sched, nsec_t now) {
+    q_param* task;
+    t_param* param;
+    unsigned int in_flight;
+    nsec_t release;
+    bool skip;
+
+    while (sched->heap.size > 0 && sched->heap.node[0]->qt <= now) {
+        task = sched->heap.node[0];
+        param = task->param;
+        if (task->type == TYPE_ARRIVAL) {
+            /* aperiodic job for the server */
+            server_arrival(sched, task);
         }
-        else if (pending_tasks[i].status == RUNNING && !taskIsSuspended(id)) {
-            /* restart the task (missed deadline) */
-            print_log_prefix(LOG_WARNING);
-            printf("scheduler   | task (%s) missed deadline\n", taskName(id));
-            if (taskRestart(id) == ERROR) {
-                print_log_prefix(LOG_ERROR);
-                printf("scheduler   | task (%s) cannot restart\n", taskName(id));
+        else if (task->status == RUNNING && task->qt == task->abs_deadline) {
+            /* deadline of the current job */
+            if (param->finished == param->released) {
+                TRACE(LOG_DEBUG, EV_IN_TIME, param->name);
+                task->status = WAITING;
+                active_remove(sched, task);
+            }
+            else {
+                TRACE(LOG_WARNING, EV_MISSED, param->name);
+                task->status = LATE;
+                /* a late result is worthless for an aborting task */
+                if (param->policy == POLICY_ABORT)
+                    param->abort_job = param->finished;
             }
-			/* set the new queue time */
-			pending_tasks[i].qt.tv_sec = pending_tasks[i].qt.tv_sec + period;
+            task->qt = task->release;
         }
-        else if (pending_tasks[i].status == RUNNING && taskIsSuspended(id)) {
-            /* task was executed in time */
-            pending_tasks[i].status = WAITING;
-			print_log_prefix(LOG_DEBUG);
-			printf("scheduler   | task (%s) executed in time\n", taskName(id));
+        else {
+            /* release of a new job: instead of restarting a task that is still
+             * busy, its overrun policy decides whether the job is queued,
+             * the running one aborted or this release skipped */
+            in_flight = param->released - param->finished;
+            skip = false;
+            if (param->skip) {
+                param->skip = 0;
+                skip = true;
+            }
+            else if (in_flight > 0) {
+                if (param->policy == POLICY_SKIP || in_flight >= JOB_QUEUE)
+                    skip = true;
+                else if (param->policy == POLICY_ABORT)
+                    param->abort_job = param->finished;
+            }
+            release = task->release;
+            task->release = release + task->period;
+
+            if (skip) {
+                param->skipped++;
+                TRACE(LOG_WARNING, EV_SKIPPED, param->name);
+                task->qt = task->release;
+            }
+            else {
+                /* its priority follows from the rank of its absolute deadline
+                 * among all active jobs */
+                task->abs_deadline = release + task->deadline;
+                param->job_deadline[param->released % JOB_QUEUE] = task->abs_deadline;
+                param->job_release[param->released % JOB_QUEUE] = release;
+                stat_add(&param->jitter, now - release);
+                param->released++;
+                if (param->demoted) {
+                    param->demoted = 0;
+                    task->prio = BG_PRIO;
+                }
+                active_move(sched, task);
+                if (!simulated)
+                    semGive(param->release_sem);
+                TRACE(LOG_INFO, EV_ACTIVATED, param->name);
+                task->qt = task->abs_deadline;
+                task->status = RUNNING;
+            }
         }
+        heap_sift_down(&sched->heap, 0);
     }
 
-    /* get next queue time */
-	intervaltimer.it_value.tv_sec = pending_tasks[0].qt.tv_sec;
-    for (i=1; i<MAX_PERIODIC; i++) {
-        if ((intervaltimer.it_value.tv_sec > pending_tasks[i].qt.tv_sec)
-				&& (pending_tasks[i].qt.tv_sec != 0)) {
-            intervaltimer.it_value.tv_sec = pending_tasks[i].qt.tv_sec;
+    /* rank the server by the deadline of its current job */
+    if (sched->server != NULL)
+        server_update(sched);
+    active_flush(sched);
+}
+
+
+/*************************************************************************/
+/*  aperiodic server                                                     */
+/*                                                                       */
+/*************************************************************************/
+
+void server_arrival(t_sched* sched, q_param* source) {
+    t_server* server = sched->server;
+    a_param* param = &server->source[source->id];
+    a_job* job;
+
+    if (server->tail - server->head >= SERVER_QUEUE) {
+        server->overflow++;
+        TRACE(LOG_WARNING, EV_AP_DROPPED, source->id+1);
+    }
+    else {
+        job = &server->queue[server->tail % SERVER_QUEUE];
+        job->arrival = source->qt;
+        job->exec_time = param->exec_time;
+        job->source = source->id;
+        job->deadline = (job->arrival > server->last_deadline)
+            ? job->arrival : server->last_deadline;
+        job->deadline += (nsec_t)(job->exec_time / server->util);
+        server->last_deadline = job->deadline;
+        server->tail++;
+        if (!simulated)
+            semGive(server->sem);
+        TRACE(LOG_INFO, EV_AP_ARRIVED, source->id+1, job->deadline / NSEC_PER_SEC,
+                (int)(job->deadline % NSEC_PER_SEC / NSEC_PER_USEC));
+    }
+    source->qt += random_exp(param->interarrival);
+}
+
+void server_update(t_sched* sched) {
+    t_server* server = sched->server;
+    unsigned int head = server->head;
+    q_param* task = &server->task;
+
+    server->seen_head = head;
+    if (head == server->tail) {
+        active_remove(sched, task);
+        return;
+    }
+    if (task->active_idx >= 0
+            && task->abs_deadline == server->queue[head % SERVER_QUEUE].deadline)
+        return;
+    task->abs_deadline = server->queue[head % SERVER_QUEUE].deadline;
+    active_move(sched, task);
+}
+
+/* let the scheduler re-rank the server right away */
+void server_poke(t_server* server) {
+    struct timespec mytime;
+
+    clock_gettime(CLOCK_REALTIME, &mytime);
+    wheelTimerStart(server->timer, timespec_to_ns(&mytime), 0);
+}
+
+void aperiodic(t_server* server) {
+    struct timespec mytime;
+
+    while (1) {
+        semTake(server->sem, WAIT_FOREVER);
+        while (server->head != server->tail) {
+            burn(server->queue[server->head % SERVER_QUEUE].exec_time);
+            clock_gettime(CLOCK_REALTIME, &mytime);
+            server_done(server, timespec_to_ns(&mytime));
+            server_poke(server);
         }
     }
-	
-	print_log_prefix(LOG_DEBUG);
-	printf("scheduler   | timer set to %ds\n", intervaltimer.it_value.tv_sec);
+}
+
+/* the job at head finished: account its response time and dequeue it */
+void server_done(t_server* server, nsec_t finish) {
+    a_job* job = &server->queue[server->head % SERVER_QUEUE];
+    a_param* param = &server->source[job->source];
+    nsec_t resp = finish - job->arrival;
+
+    param->resp_sum += resp;
+    if (param->jobs == 0 || resp < param->resp_min)
+        param->resp_min = resp;
+    if (resp > param->resp_max)
+        param->resp_max = resp;
+    param->jobs++;
+    TRACE(LOG_INFO, EV_AP_DONE, job->source+1, resp / NSEC_PER_USEC,
+            (finish > job->deadline) ? " (late)" : "");
+    server->head++;
+}
+
+/* exponentially distributed delay for Poisson arrivals */
+nsec_t random_exp(nsec_t mean) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    nsec_t t = (nsec_t)(-log(u) * mean);
+    return (t > 0) ? t : 1;
+}
+
+
+/*************************************************************************/
+/*  active jobs                                                          */
+/*                                                                       */
+/*  jobs released but not yet seen complete, sorted by absolute         */
+/*  deadline; the job at rank r runs at priority MAX_PRIO + r, ranks     */
+/*  beyond the available levels share MIN_PRIO, which stays above        */
+/*  BG_PRIO on the host too. Ranks are updated per event, the kernel     */
+/*  priorities once per handler by active_flush()                        */
+/*                                                                       */
+/*************************************************************************/
+
+/* deadline order, ties ordered by task ID */
+bool active_before(q_param* a, q_param* b) {
+    return a->abs_deadline < b->abs_deadline
+        || (a->abs_deadline == b->abs_deadline && a->id < b->id);
+}
+
+void active_insert(t_sched* sched, q_param* task) {
+    int lo = 0, hi = sched->active_cnt, mid;
 
-    /* mark tasks to be activated next*/
-    for (i=0; i<MAX_PERIODIC; i++) {
-        if (intervaltimer.it_value.tv_sec == pending_tasks[i].qt.tv_sec) {
-            pending_tasks[i].status = READY;
+    /* binary search for the insertion point */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (active_before(sched->active[mid], task))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    memmove(&sched->active[lo+1], &sched->active[lo],
+            (sched->active_cnt - lo) * sizeof(q_param*));
+    sched->active[lo] = task;
+    sched->active_cnt++;
+    active_reprio(sched, lo, sched->active_cnt - 1);
+}
+
+void active_remove(t_sched* sched, q_param* task) {
+    int i = task->active_idx;
+
+    if (i < 0)
+        return;
+    memmove(&sched->active[i], &sched->active[i+1],
+            (sched->active_cnt - i - 1) * sizeof(q_param*));
+    sched->active_cnt--;
+    task->active_idx = -1;
+    active_reprio(sched, i, sched->active_cnt - 1);
+}
+
+/* the absolute deadline of the task changed: only the jobs between its
+ * old and its new rank move, by one place each */
+void active_move(t_sched* sched, q_param* task) {
+    int i = task->active_idx, j;
+
+    if (i < 0) {
+        active_insert(sched, task);
+        return;
+    }
+    for (j = i; j + 1 < sched->active_cnt
+            && active_before(sched->active[j+1], task); j++)
+        sched->active[j] = sched->active[j+1];
+    for (; j > 0 && active_before(task, sched->active[j-1]); j--)
+        sched->active[j] = sched->active[j-1];
+    sched->active[j] = task;
+    if (j < i)
+        active_reprio(sched, j, i);
+    else
+        active_reprio(sched, i, j);
+}
+
+/* reassign the ranks from..to and queue the jobs whose rank now calls for
+ * another priority than the one set */
+void active_reprio(t_sched* sched, int from, int to) {
+    int i, prio;
+    q_param* task;
+
+    for (i = from; i <= to; i++) {
+        task = sched->active[i];
+        task->active_idx = i;
+        prio = (i < MIN_PRIO - MAX_PRIO) ? MAX_PRIO + i : MIN_PRIO;
+        if (task->prio != prio && !task->moved) {
+            task->moved = true;
+            sched->moved[sched->moved_cnt++] = task;
         }
     }
+}
 
-	/* set and arm timer */
-	intervaltimer.it_value.tv_nsec = 0;
-	intervaltimer.it_interval.tv_sec = 0;
-	intervaltimer.it_interval.tv_nsec = 0;
-	if (timer_settime(callingtimer, TIMER_ABSTIME, &intervaltimer, NULL) == ERROR ) {
-        print_log_prefix(LOG_ERROR);
-        printf("scheduler   | set_timer\n");
+/* set the priorities of the queued jobs from their final rank. Each level
+ * above MIN_PRIO ends up with one job, so once every job got its first
+ * priority a handler makes at most twice MIN_PRIO - MAX_PRIO calls to
+ * taskPrioritySet(), however many events it handled */
+void active_flush(t_sched* sched) {
+    int i, prio;
+    q_param* task;
+
+    for (i = 0; i < sched->moved_cnt; i++) {
+        task = sched->moved[i];
+        task->moved = false;
+        /* a demoted job keeps its background priority until its next
+         * release, a job no longer active keeps its last one */
+        if (task->active_idx < 0
+                || (task->param != NULL && task->param->demoted))
+            continue;
+        prio = (task->active_idx < MIN_PRIO - MAX_PRIO)
+            ? MAX_PRIO + task->active_idx : MIN_PRIO;
+        if (task->prio != prio) {
+            task->prio = prio;
+            if (!simulated)
+                taskPrioritySet(task->id, prio);
+        }
     }
+    sched->moved_cnt = 0;
 }
 
 
@@ -262,44 +1493,467 @@ void scheduler(timer_t callingtimer, q_param* pending_tasks) {
 /*                                                                       */
 /*************************************************************************/
 
-void periodic(int exec_time) {
+/* the job is executed in slices so that its consumed time can be accounted
+ * and checked against the budget while it runs; consumed is the CPU time
+ * the thread spent on the job, measured after every slice */
+void periodic(t_param* param) {
+    unsigned int job;
+    nsec_t consumed, slice, cpu_start;
+    bool overrun;
+    struct timespec mytime;
+
     while(1) {
-        print_log_prefix(LOG_INFO);
-        printf("%s | execution started\n", taskName(taskIdSelf()));
-        taskDelay(exec_time*60);
-        print_log_prefix(LOG_INFO);
-        printf("%s | execution finished\n", taskName(taskIdSelf()));
-        taskSuspend(0);
+        semTake(param->release_sem, WAIT_FOREVER);
+        job = param->finished;
+        clock_gettime(CLOCK_REALTIME, &mytime);
+        job_start(param, job, timespec_to_ns(&mytime));
+
+        consumed = 0;
+        overrun = false;
+        cpu_start = thread_cpu_ns();
+        while (consumed < param->actual_time && param->abort_job != job) {
+            slice = param->actual_time - consumed;
+            if (slice > BURN_SLICE)
+                slice = BURN_SLICE;
+            burn(slice);
+            consumed = thread_cpu_ns() - cpu_start;
+            if (!overrun && consumed > param->exec_time) {
+                overrun = true;
+                if (job_overrun(param))
+                    break;
+                if (param->demoted)
+                    taskPrioritySet(0, BG_PRIO);
+            }
+        }
+
+        clock_gettime(CLOCK_REALTIME, &mytime);
+        job_finish(param, job, consumed, timespec_to_ns(&mytime));
+    }
+}
+
+void job_start(t_param* param, unsigned int job, nsec_t start) {
+    stat_add(&param->latency, start - param->job_release[job % JOB_QUEUE]);
+    TRACE(LOG_INFO, EV_STARTED, param->name);
+}
+
+/* budget exhausted: apply the overrun policy, true if the job must stop */
+bool job_overrun(t_param* param) {
+    param->overruns++;
+    TRACE(LOG_WARNING, EV_OVERRUN, param->name);
+    if (param->policy == POLICY_ABORT)
+        return true;
+    if (param->policy == POLICY_DEMOTE)
+        param->demoted = 1;
+    else if (param->policy == POLICY_SKIP)
+        param->skip = 1;
+    return false;
+}
+
+/* account a finished or aborted job */
+void job_finish(t_param* param, unsigned int job, nsec_t consumed, nsec_t finish) {
+    nsec_t deadline = param->job_deadline[job % JOB_QUEUE];
+
+    param->consumed += consumed;
+    stat_add(&param->response, finish - param->job_release[job % JOB_QUEUE]);
+    stat_add(&param->lateness, finish - deadline);
+    if (finish > deadline) {
+        param->late++;
+        if (finish - deadline > param->tardiness_max)
+            param->tardiness_max = finish - deadline;
     }
+    if (consumed < param->actual_time) {
+        param->aborted++;
+        TRACE(LOG_INFO, EV_ABORTED, param->name);
+    }
+    else {
+        TRACE(LOG_INFO, EV_FINISHED, param->name);
+    }
+    param->finished++;
 }
 
 
 /*************************************************************************/
-/*  print log prefix                                                     */
+/*  discrete-event simulation                                            */
+/*                                                                       */
+/*  the schedulers run on a virtual clock that jumps from event to event */
+/*  (release, deadline, arrival, job completion, budget exhaustion). On  */
+/*  the cores of each scheduler the active jobs of best rank execute, as */
+/*  the priorities set by active_reprio() make the kernel do; demoted    */
+/*  jobs only get otherwise idle cores. Nothing depends on the host, so  */
+/*  a run is reproducible bit for bit from its seed.                     */
 /*                                                                       */
 /*************************************************************************/
 
-void print_log_prefix(int type) {
+void simulate(t_param* t_params, int task_cnt, t_server* server, int cores,
+        int mode, nsec_t end) {
+    t_sched sched[MAX_CORES];
+    q_param* run[MAX_CORES];
+    t_sched* owner[MAX_CORES];
+    t_param* param;
+    int sets = (mode == MODE_GLOBAL) ? 1 : cores;
+    int cpus = (mode == MODE_GLOBAL) ? cores : 1;
+    int i, c, k, n;
+    nsec_t next, left, dt;
+
+    /* IDs only order equal deadlines here */
+    for (i = 0; i < task_cnt; i++)
+        t_params[i].id = i + 1;
+    tidAperiodic = task_cnt + 1;
+    for (c = 0; c < sets; c++) {
+        if (sched_init(&sched[c], t_params, task_cnt, (c == 0) ? server : NULL,
+                    (mode == MODE_GLOBAL) ? -1 : c) == ERROR) {
+            printf("Error calloc\n");
+            return;
+        }
+    }
+
+    sim_now = 0;
+    while (sim_now < end) {
+        next = end;
+        for (c = 0; c < sets; c++) {
+            schedule_events(&sched[c], sim_now);
+            if (sched[c].heap.size > 0 && sched[c].heap.node[0]->qt < next)
+                next = sched[c].heap.node[0]->qt;
+        }
+
+        /* jobs the scheduler asked to abort stop right away */
+        for (i = 0; i < task_cnt; i++) {
+            param = &t_params[i];
+            if (param->released != param->finished
+                    && param->abort_job == param->finished)
+                sim_finish(param);
+        }
+
+        /* dispatch and run until the next event */
+        for (c = 0, n = 0; c < sets; c++) {
+            for (k = sim_pick(&sched[c], cpus, &run[n]); k > 0; k--)
+                owner[n++] = &sched[c];
+        }
+        for (k = 0; k < n; k++) {
+            param = run[k]->param;
+            if (param != NULL && !param->sim_started) {
+                param->sim_started = 1;
+                job_start(param, param->finished, sim_now);
+            }
+            left = sim_left(run[k], server);
+            if (sim_now + left < next)
+                next = sim_now + left;
+        }
+        dt = next - sim_now;
+        sim_now = next;
+        for (k = 0; k < n; k++)
+            sim_step(owner[k], run[k], server, dt);
+        traceFlush();
+    }
+
+    for (c = 0; c < sets; c++) {
+        free(sched[c].tasks);
+        free(sched[c].arrivals);
+        free(sched[c].heap.node);
+        free(sched[c].active);
+        free(sched[c].moved);
+    }
+}
+
+/* the ready jobs of best rank, at most one per core */
+int sim_pick(t_sched* sched, int cpus, q_param** run) {
+    int i, n = 0;
+    q_param* task;
+
+    for (i = 0; i < sched->active_cnt && n < cpus; i++) {
+        task = sched->active[i];
+        if (sim_ready(sched, task) && (task->param == NULL || !task->param->demoted))
+            run[n++] = task;
+    }
+    for (i = 0; i < sched->active_cnt && n < cpus; i++) {
+        task = sched->active[i];
+        if (sim_ready(sched, task) && task->param != NULL && task->param->demoted)
+            run[n++] = task;
+    }
+    return n;
+}
+
+bool sim_ready(t_sched* sched, q_param* task) {
+    if (task->param == NULL)
+        return sched->server->head != sched->server->tail;
+    return task->param->released != task->param->finished;
+}
+
+/* execution time until the job completes or exhausts its budget */
+nsec_t sim_left(q_param* task, t_server* server) {
+    t_param* param = task->param;
+
+    if (param == NULL)
+        return server->queue[server->head % SERVER_QUEUE].exec_time
+            - server->sim_consumed;
+    if (!param->sim_overrun && param->sim_consumed < param->exec_time
+            && param->actual_time > param->exec_time)
+        return param->exec_time - param->sim_consumed;
+    return param->actual_time - param->sim_consumed;
+}
+
+/* account dt of execution to a job, the clock already stands at its end */
+void sim_step(t_sched* sched, q_param* task, t_server* server, nsec_t dt) {
+    t_param* param = task->param;
+
+    if (param == NULL) {
+        server->sim_consumed += dt;
+        if (server->sim_consumed >= server->queue[server->head % SERVER_QUEUE].exec_time) {
+            server_done(server, sim_now);
+            server->sim_consumed = 0;
+            server_update(sched);
+        }
+        return;
+    }
+    param->sim_consumed += dt;
+    if (!param->sim_overrun && param->sim_consumed >= param->exec_time
+            && param->actual_time > param->exec_time) {
+        param->sim_overrun = 1;
+        if (job_overrun(param)) {
+            sim_finish(param);
+            return;
+        }
+    }
+    if (param->sim_consumed >= param->actual_time)
+        sim_finish(param);
+}
+
+void sim_finish(t_param* param) {
+    job_finish(param, param->finished, param->sim_consumed, sim_now);
+    param->sim_consumed = 0;
+    param->sim_started = 0;
+    param->sim_overrun = 0;
+}
+
+
+/*************************************************************************/
+/*  task statistics                                                      */
+/*                                                                       */
+/*  kept by the scheduler (release jitter) and by the jobs themselves    */
+/*  (start, finish, execution time). They are read without locking, so  */
+/*  a query while the tasks run may see a job half accounted.            */
+/*                                                                       */
+/*************************************************************************/
+
+void stat_add(t_stat* stat, nsec_t value) {
+    if (stat->cnt == 0 || value < stat->min)
+        stat->min = value;
+    if (stat->cnt == 0 || value > stat->max)
+        stat->max = value;
+    stat->sum += value;
+    stat->cnt++;
+}
+
+nsec_t stat_avg(const t_stat* stat) {
+    return (stat->cnt > 0) ? stat->sum / stat->cnt : 0;
+}
+
+/* statistics of task 1..stats_task_cnt so far */
+STATUS stats_get(int task, t_stats* stats) {
+    t_param* param;
+    struct timespec mytime;
+    nsec_t now;
+
+    if (task < 1 || task > stats_task_cnt)
+        return ERROR;
+    param = &stats_tasks[task-1];
+    if (simulated)
+        now = sim_now;
+    else if (clock_gettime(CLOCK_REALTIME, &mytime) == OK)
+        now = timespec_to_ns(&mytime);
+    else
+        return ERROR;
+
+    strcpy(stats->name, param->name);
+    stats->jobs = param->finished;
+    stats->missed = param->late;
+    stats->miss_ratio = stats->jobs ? (double)stats->missed / stats->jobs : 0.0;
+    stats->consumed = param->consumed;
+    stats->cpu = (now > 0) ? (double)param->consumed / now : 0.0;
+    stats->jitter = param->jitter;
+    stats->latency = param->latency;
+    stats->response = param->response;
+    stats->lateness = param->lateness;
+    return OK;
+}
+
+/* table of the statistics of all tasks, times in us */
+void stats_show(void) {
+    t_stats stats;
+    int i;
+
+    printf("\n%-12s %6s %6s %6s %6s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+            "TASK", "JOBS", "MISSED", "RATIO", "CPU", "JIT AVG", "JIT MAX",
+            "START AVG", "START MAX", "RESP AVG", "RESP MAX", "LATE AVG", "LATE MAX");
+    for (i = 1; i <= stats_task_cnt; i++) {
+        if (stats_get(i, &stats) == ERROR)
+            continue;
+        printf("%-12s %6d %6d %6.4f %5.1f%% %9lld %9lld %9lld %9lld %9lld %9lld %9lld %9lld\n",
+                stats.name, stats.jobs, stats.missed, stats.miss_ratio,
+                stats.cpu * 100, stat_avg(&stats.jitter) / NSEC_PER_USEC,
+                stats.jitter.max / NSEC_PER_USEC,
+                stat_avg(&stats.latency) / NSEC_PER_USEC,
+                stats.latency.max / NSEC_PER_USEC,
+                stat_avg(&stats.response) / NSEC_PER_USEC,
+                stats.response.max / NSEC_PER_USEC,
+                stat_avg(&stats.lateness) / NSEC_PER_USEC,
+                stats.lateness.max / NSEC_PER_USEC);
+    }
+    printf("\n");
+}
+
+
+/*************************************************************************/
+/*  log prefix                                                           */
+/*                                                                       */
+/*************************************************************************/
+
+/* time and type of a trace record, written by the trace drainer */
+void log_prefix(FILE* out, const TRACE_REC* rec) {
     const char* str_type;
-	struct timespec mytime;
-    if (type == LOG_ERROR) {
+
+    if (rec->level == LOG_ERROR) {
         str_type = "error  ";
     }
-    else if (type == LOG_WARNING) {
+    else if (rec->level == LOG_WARNING) {
         str_type = "warning";
     }
-    else if (type == LOG_INFO) {
+    else if (rec->level == LOG_INFO) {
         str_type = "info   ";
     }
-	else if (type == LOG_DEBUG) {
+	else {
 		str_type = "debug  ";
 	}
+    fprintf(out, "%04d.%06ds | %s | ", (int)(rec->stamp / NSEC_PER_SEC),
+            (int)(rec->stamp % NSEC_PER_SEC / NSEC_PER_USEC), str_type);
+}
+
+/* trace clock in simulation mode */
+long long sim_clock(void) {
+    return sim_now;
+}
+
+
+/*************************************************************************/
+/*  emulated execution                                                   */
+/*                                                                       */
+/*  a job consumes its execution time in a calibrated busy loop and      */
+/*  reads back what it took from the CPU clock of its thread, so time    */
+/*  spent preempted by other jobs is not counted as execution            */
+/*                                                                       */
+/*************************************************************************/
+
+void burn_calibrate(void) {
+    struct timespec t0, t1;
+    nsec_t elapsed;
+    long n = 0;
 
-    if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR) {
-        printf("----s | error   |              | clock_gettime\n", taskIdSelf());
-        printf("----s | %s | ", str_type);
+    burn_per_ms = 0;
+    clock_gettime(CLOCK_REALTIME, &t0);
+    do {
+        burn_loop(10000);
+        n += 10000;
+        clock_gettime(CLOCK_REALTIME, &t1);
+        elapsed = timespec_to_ns(&t1) - timespec_to_ns(&t0);
+    } while (elapsed < CALIB_TIME);
+    burn_per_ms = (long)(n * NSEC_PER_MSEC / elapsed);
+    if (burn_per_ms < 1)
+        burn_per_ms = 1;
+}
+
+void burn_loop(long n) {
+    volatile long i;
+    for (i = 0; i < n; i++);
+}
+
+void burn(nsec_t exec_time) {
+    burn_loop((long)(exec_time * burn_per_ms / NSEC_PER_MSEC));
+}
+
+/* CPU time of the calling thread; without a thread CPU clock the jobs
+ * are measured in elapsed time, which includes preemptions */
+nsec_t thread_cpu_ns(void) {
+    static bool wall_clock = false;
+    struct timespec ts;
+
+    if (!wall_clock && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return timespec_to_ns(&ts);
+    if (!wall_clock) {
+        wall_clock = true;
+        printf("Warning: no thread CPU clock, consumed times are elapsed times\n");
     }
-    else {
-        printf("%04ds | %s | ", (int)mytime.tv_sec, str_type);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+
+/*************************************************************************/
+/*  time conversion                                                      */
+/*                                                                       */
+/*************************************************************************/
+
+nsec_t timespec_to_ns(const struct timespec* ts) {
+    return (nsec_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+void ns_to_timespec(nsec_t ns, struct timespec* ts) {
+    ts->tv_sec  = (time_t)(ns / NSEC_PER_SEC);
+    ts->tv_nsec = (long)(ns % NSEC_PER_SEC);
+}
+
+
+
+/*************************************************************************/
+/*  release heap                                                         */
+/*                                                                       */
+/*  binary min-heap ordered by queue time; the scheduler only ever       */
+/*  handles the top, and sifts it down after moving its queue time on.   */
+/*  Releases and deadlines never update a node below the root, so the    */
+/*  heap keeps no index of positions and no remove or update by task     */
+/*                                                                       */
+/*************************************************************************/
+
+/* equal queue times are ordered by task ID to keep the order stable */
+int heap_cmp(q_param* a, q_param* b) {
+    if (a->qt != b->qt)
+        return (a->qt < b->qt) ? -1 : 1;
+    if (a->id != b->id)
+        return (a->id < b->id) ? -1 : 1;
+    return 0;
+}
+
+void heap_swap(t_heap* heap, int i, int j) {
+    q_param* tmp = heap->node[i];
+    heap->node[i] = heap->node[j];
+    heap->node[j] = tmp;
+}
+
+void heap_sift_up(t_heap* heap, int i) {
+    int parent;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (heap_cmp(heap->node[i], heap->node[parent]) >= 0)
+            break;
+        heap_swap(heap, i, parent);
+        i = parent;
     }
 }
+
+void heap_sift_down(t_heap* heap, int i) {
+    int child;
+    while ((child = 2*i + 1) < heap->size) {
+        if (child + 1 < heap->size
+                && heap_cmp(heap->node[child+1], heap->node[child]) < 0)
+            child++;
+        if (heap_cmp(heap->node[child], heap->node[i]) >= 0)
+            break;
+        heap_swap(heap, i, child);
+        i = child;
+    }
+}
+
+/* the node array must have room for one more entry */
+void heap_push(t_heap* heap, q_param* task) {
+    heap->node[heap->size++] = task;
+    heap_sift_up(heap, heap->size - 1);
+}
@@ -0,0 +1,19 @@
+/*************************************************************************/
+/*  cpuset.h                                                             */
+/*                                                                       */
+/*  host emulation: CPU sets for task affinity                           */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCcpuseth
+#define __INCcpuseth
+
+typedef unsigned int cpuset_t;
+
+#define CPUSET_ZERO(cs)       ((cs) = 0)
+#define CPUSET_SET(cs, n)     ((cs) |= (1u << (n)))
+#define CPUSET_CLR(cs, n)     ((cs) &= ~(1u << (n)))
+#define CPUSET_ISSET(cs, n)   (((cs) & (1u << (n))) != 0)
+#define CPUSET_ISZERO(cs)     ((cs) == 0)
+
+#endif /* __INCcpuseth */
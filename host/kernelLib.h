@@ -0,0 +1,15 @@
+/*************************************************************************/
+/*  kernelLib.h                                                          */
+/*                                                                       */
+/*  host emulation: kernel configuration                                 */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCkernelLibh
+#define __INCkernelLibh
+
+#include "vxWorks.h"
+
+STATUS kernelTimeSlice(int ticks);
+
+#endif /* __INCkernelLibh */
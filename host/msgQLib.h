@@ -0,0 +1,35 @@
+/*************************************************************************/
+/*  msgQLib.h                                                            */
+/*                                                                       */
+/*  host emulation: message queues                                       */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCmsgQLibh
+#define __INCmsgQLibh
+
+#include "vxWorks.h"
+#include "objLib.h"
+
+#define M_msgQLib                     (65 << 16)
+#define S_msgQLib_INVALID_MSG_LENGTH  (M_msgQLib | 1)
+
+/* message queue options */
+#define MSG_Q_FIFO      0x00
+#define MSG_Q_PRIORITY  0x01
+
+/* message priorities */
+#define MSG_PRI_NORMAL  0
+#define MSG_PRI_URGENT  1
+
+typedef struct msg_q* MSG_Q_ID;
+
+MSG_Q_ID msgQCreate(int maxMsgs, int maxMsgLength, int options);
+STATUS   msgQDelete(MSG_Q_ID msgQId);
+STATUS   msgQSend(MSG_Q_ID msgQId, char* buffer, unsigned int nBytes,
+               int timeout, int priority);
+int      msgQReceive(MSG_Q_ID msgQId, char* buffer, unsigned int maxNBytes,
+               int timeout);
+int      msgQNumMsgs(MSG_Q_ID msgQId);
+
+#endif /* __INCmsgQLibh */
@@ -0,0 +1,17 @@
+/*************************************************************************/
+/*  objLib.h                                                             */
+/*                                                                       */
+/*  host emulation: kernel object error codes                            */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCobjLibh
+#define __INCobjLibh
+
+#define M_objLib                  (61 << 16)
+#define S_objLib_OBJ_ID_ERROR     (M_objLib | 1)
+#define S_objLib_OBJ_UNAVAILABLE  (M_objLib | 2)
+#define S_objLib_OBJ_DELETED      (M_objLib | 3)
+#define S_objLib_OBJ_TIMEOUT      (M_objLib | 4)
+
+#endif /* __INCobjLibh */
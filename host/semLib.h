@@ -0,0 +1,40 @@
+/*************************************************************************/
+/*  semLib.h                                                             */
+/*                                                                       */
+/*  host emulation: binary, counting and mutual-exclusion semaphores     */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCsemLibh
+#define __INCsemLibh
+
+#include "vxWorks.h"
+#include "objLib.h"
+
+/* semaphore options */
+#define SEM_Q_FIFO          0x00
+#define SEM_Q_PRIORITY      0x01
+#define SEM_DELETE_SAFE     0x04
+#define SEM_INVERSION_SAFE  0x08
+
+/* error codes */
+#define M_semLib                   (22 << 16)
+#define S_semLib_INVALID_OPTION    (M_semLib | 2)
+#define S_semLib_INVALID_OPERATION (M_semLib | 4)
+
+/* binary semaphore initial state */
+typedef enum {
+    SEM_EMPTY = 0,
+    SEM_FULL  = 1
+} SEM_B_STATE;
+
+typedef struct semaphore* SEM_ID;
+
+SEM_ID semBCreate(int options, SEM_B_STATE initialState);
+SEM_ID semCCreate(int options, int initialCount);
+SEM_ID semMCreate(int options);
+STATUS semDelete(SEM_ID semId);
+STATUS semTake(SEM_ID semId, int timeout);
+STATUS semGive(SEM_ID semId);
+
+#endif /* __INCsemLibh */
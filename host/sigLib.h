@@ -0,0 +1,15 @@
+/*************************************************************************/
+/*  sigLib.h                                                             */
+/*                                                                       */
+/*  host emulation: signals                                              */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCsigLibh
+#define __INCsigLibh
+
+#include <signal.h>
+#include <unistd.h>
+#include "vxWorks.h"
+
+#endif /* __INCsigLibh */
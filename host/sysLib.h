@@ -0,0 +1,21 @@
+/*************************************************************************/
+/*  sysLib.h                                                             */
+/*                                                                       */
+/*  host emulation: system clock rate                                    */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCsysLibh
+#define __INCsysLibh
+
+#include "vxWorks.h"
+
+/* default tick rate of the lecture target */
+#ifndef VXH_CLK_RATE
+#define VXH_CLK_RATE  60
+#endif
+
+int    sysClkRateGet(void);
+STATUS sysClkRateSet(int ticksPerSecond);
+
+#endif /* __INCsysLibh */
@@ -0,0 +1,51 @@
+/*************************************************************************/
+/*  taskLib.h                                                            */
+/*                                                                       */
+/*  host emulation: tasks on top of POSIX threads                        */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCtaskLibh
+#define __INCtaskLibh
+
+#include "vxWorks.h"
+#include "objLib.h"
+#include "cpuset.h"
+
+#define M_taskLib                    (3 << 16)
+#define S_taskLib_ILLEGAL_PRIORITY   (M_taskLib | 101)
+#define S_taskLib_ILLEGAL_OPERATION  (M_taskLib | 102)
+
+/* host emulation limits */
+#define VX_TASK_NAME_LENGTH  31
+#define VXH_MAX_TASKS        65536
+#define VXH_PRIO_LOWEST      195    /* lowest priority with a host level of
+                                       its own, the ones below share one */
+
+int    taskSpawn(char* name, int priority, int options, int stackSize,
+               FUNCPTR entryPt, _Vx_usr_arg_t arg1, _Vx_usr_arg_t arg2,
+               _Vx_usr_arg_t arg3, _Vx_usr_arg_t arg4, _Vx_usr_arg_t arg5,
+               _Vx_usr_arg_t arg6, _Vx_usr_arg_t arg7, _Vx_usr_arg_t arg8,
+               _Vx_usr_arg_t arg9, _Vx_usr_arg_t arg10);
+int    taskCreate(char* name, int priority, int options, int stackSize,
+               FUNCPTR entryPt, _Vx_usr_arg_t arg1, _Vx_usr_arg_t arg2,
+               _Vx_usr_arg_t arg3, _Vx_usr_arg_t arg4, _Vx_usr_arg_t arg5,
+               _Vx_usr_arg_t arg6, _Vx_usr_arg_t arg7, _Vx_usr_arg_t arg8,
+               _Vx_usr_arg_t arg9, _Vx_usr_arg_t arg10);
+STATUS taskActivate(int tid);
+STATUS taskDelete(int tid);
+STATUS taskSuspend(int tid);
+STATUS taskResume(int tid);
+STATUS taskRestart(int tid);
+STATUS taskDelay(int ticks);
+STATUS taskPrioritySet(int tid, int newPriority);
+STATUS taskPriorityGet(int tid, int* pPriority);
+STATUS taskCpuAffinitySet(int tid, cpuset_t affinity);
+STATUS taskCpuAffinityGet(int tid, cpuset_t* pAffinity);
+STATUS taskIdVerify(int tid);
+BOOL   taskIsSuspended(int tid);
+BOOL   taskIsReady(int tid);
+int    taskIdSelf(void);
+char*  taskName(int tid);
+
+#endif /* __INCtaskLibh */
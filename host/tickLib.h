@@ -0,0 +1,16 @@
+/*************************************************************************/
+/*  tickLib.h                                                            */
+/*                                                                       */
+/*  host emulation: system tick counter                                  */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCtickLibh
+#define __INCtickLibh
+
+#include "vxWorks.h"
+#include "sysLib.h"
+
+unsigned long tickGet(void);
+
+#endif /* __INCtickLibh */
@@ -0,0 +1,43 @@
+/*************************************************************************/
+/*  time.h                                                               */
+/*                                                                       */
+/*  host emulation: POSIX clocks and timers with VxWorks extensions      */
+/*                                                                       */
+/*  CLOCK_REALTIME is virtualised so that clock_settime() does not touch */
+/*  the host clock; timers run their handlers on a helper thread which   */
+/*  takes the identity and priority of the task that created the timer.  */
+/*                                                                       */
+/*************************************************************************/
+
+#include_next <time.h>
+
+#ifndef __INCvxhTimeh
+#define __INCvxhTimeh
+
+#include "vxWorks.h"
+
+int vxhClockGettime(clockid_t clockId, struct timespec* tp);
+int vxhClockSettime(clockid_t clockId, const struct timespec* tp);
+int vxhClockNanosleep(clockid_t clockId, int flags,
+        const struct timespec* rqtp, struct timespec* rmtp);
+int vxhTimerCreate(clockid_t clockId, struct sigevent* evp, timer_t* pTimer);
+int vxhTimerDelete(timer_t timerId);
+int vxhTimerSettime(timer_t timerId, int flags,
+        const struct itimerspec* value, struct itimerspec* ovalue);
+int vxhTimerGettime(timer_t timerId, struct itimerspec* value);
+
+/* VxWorks extensions */
+int timer_connect(timer_t timerId, VOIDFUNCPTR routine, _Vx_usr_arg_t arg);
+int timer_cancel(timer_t timerId);
+
+#ifndef VXHOST_INTERNAL
+#define clock_gettime(c, t)         vxhClockGettime(c, t)
+#define clock_settime(c, t)         vxhClockSettime(c, t)
+#define clock_nanosleep(c, f, r, m) vxhClockNanosleep(c, f, r, m)
+#define timer_create(c, e, t)       vxhTimerCreate(c, e, t)
+#define timer_delete(t)             vxhTimerDelete(t)
+#define timer_settime(t, f, v, o)   vxhTimerSettime(t, f, v, o)
+#define timer_gettime(t, v)         vxhTimerGettime(t, v)
+#endif
+
+#endif /* __INCvxhTimeh */
@@ -0,0 +1,17 @@
+/*************************************************************************/
+/*  vxCpuLib.h                                                           */
+/*                                                                       */
+/*  host emulation: CPU enumeration for SMP                              */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCvxCpuLibh
+#define __INCvxCpuLibh
+
+#include "vxWorks.h"
+#include "cpuset.h"
+
+unsigned int vxCpuConfiguredGet(void);
+cpuset_t     vxCpuEnabledGet(void);
+
+#endif /* __INCvxCpuLibh */
@@ -0,0 +1,1175 @@
+/*************************************************************************/
+/*  vxHost.c                                                             */
+/*                                                                       */
+/*  Linux user-space emulation of the VxWorks API subset used by the     */
+/*  lecture programs. Tasks are SCHED_FIFO (SCHED_RR with time slicing)  */
+/*  pthreads; VxWorks priorities 100-195 map one-to-one onto the host    */
+/*  real-time levels. If the host refuses real-time scheduling, tasks    */
+/*  run as SCHED_OTHER threads and priorities are only bookkept.         */
+/*                                                                       */
+/*************************************************************************/
+
+#define VXHOST_INTERNAL
+
+/* includes */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "vxWorks.h"
+#include "taskLib.h"
+#include "semLib.h"
+#include "msgQLib.h"
+#include "kernelLib.h"
+#include "tickLib.h"
+#include "sysLib.h"
+#include "vxCpuLib.h"
+#include "sigLib.h"
+#include "time.h"
+
+/* defines */
+#define NSEC_PER_SEC     1000000000LL
+#define VXH_MAX_ARGS     10
+#define VXH_MIN_STACK    (64 * 1024)
+#define VXH_SIG_SUSPEND  (SIGRTMIN + 1)
+#define VXH_SIG_RESUME   (SIGRTMIN + 2)
+#define VXH_PRIO_BASE    100
+#define VXH_CANCEL_POLL  (10 * 1000000LL)  /* ns, mutex waits and taskDelete */
+
+#define SEM_TYPE_BINARY   0
+#define SEM_TYPE_COUNTING 1
+#define SEM_TYPE_MUTEX    2
+
+typedef struct vxh_timer VXH_TIMER;
+
+typedef struct vxh_tcb {
+    int             id;
+    char            name[VX_TASK_NAME_LENGTH + 1];
+    int             priority;
+    FUNCPTR         entry;
+    _Vx_usr_arg_t   args[VXH_MAX_ARGS];
+    int             stackSize;
+    cpuset_t        affinity;   /* empty: may run on any CPU */
+    pthread_t       thread;
+    BOOL            started;    /* a thread is attached to the task */
+    BOOL            deleted;
+    volatile sig_atomic_t suspended;
+    pthread_mutex_t lock;
+    pthread_cond_t  resume;
+    VXH_TIMER*      timers;     /* timers owned by the task */
+} VXH_TCB;
+
+struct vxh_timer {
+    clockid_t       clock;
+    VOIDFUNCPTR     routine;
+    _Vx_usr_arg_t   arg;
+    VXH_TCB*        owner;
+    VXH_TIMER*      next;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    long long       expiry;     /* monotonic ns, 0 when disarmed */
+    long long       interval;
+    BOOL            deleted;
+    BOOL            detached;
+};
+
+struct semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             type;
+    int             count;
+    pthread_mutex_t mutex;      /* SEM_TYPE_MUTEX instead of lock/count */
+};
+
+struct msg_q {
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty;
+    pthread_cond_t  notFull;
+    int             maxMsgs;
+    int             maxMsgLength;
+    int             head;
+    int             count;
+    unsigned int*   length;
+    char*           buf;
+};
+
+/* task table, ids are never reused so stale ids fail taskIdVerify() */
+static VXH_TCB*        vxhTasks[VXH_MAX_TASKS];
+static int             vxhTaskCnt = 0;
+static pthread_mutex_t vxhTaskLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread VXH_TCB* vxhSelf = NULL;
+
+static BOOL      vxhRealTime = TRUE;
+static int       vxhTimeSlice = 0;
+static int       vxhClkRate = VXH_CLK_RATE;
+static long long vxhRtOffset = 0;   /* virtual CLOCK_REALTIME - CLOCK_MONOTONIC */
+static long long vxhBootTime = 0;
+
+/* function declarations */
+static long long vxhMonoNow(void);
+static void      vxhNsToTs(long long, struct timespec*);
+static long long vxhTsToNs(const struct timespec*);
+static long long vxhTimeoutDeadline(int);
+static int       vxhCondWait(pthread_cond_t*, pthread_mutex_t*, long long);
+static void      vxhCondInit(pthread_cond_t*);
+static void      vxhUnlock(void*);
+static int       vxhHostPolicy(void);
+static int       vxhHostPriority(int);
+static VXH_TCB*  vxhTcbGet(int);
+static VXH_TCB*  vxhTcbAlloc(const char*, int, FUNCPTR, _Vx_usr_arg_t*, int);
+static STATUS    vxhTaskStart(VXH_TCB*);
+static void      vxhTaskStop(VXH_TCB*);
+static void*     vxhTaskWrapper(void*);
+static void      vxhAffinityMask(VXH_TCB*, cpu_set_t*);
+static void*     vxhTimerThread(void*);
+static STATUS    vxhMutexTake(SEM_ID, int);
+static void      vxhSigSuspend(int);
+static void      vxhSigResume(int);
+
+
+/*************************************************************************/
+/*  initialisation                                                       */
+/*                                                                       */
+/*************************************************************************/
+
+__attribute__((constructor))
+static void vxhInit(void) {
+    struct sigaction sa;
+    struct sched_param param;
+    struct timespec now;
+
+    vxhBootTime = vxhMonoNow();
+    clock_gettime(CLOCK_REALTIME, &now);
+    vxhRtOffset = vxhTsToNs(&now) - vxhBootTime;
+
+    /* suspension of other tasks is done with a signal that parks the target
+     * in its handler until it is resumed */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = vxhSigSuspend;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, VXH_SIG_RESUME);
+    sigaction(VXH_SIG_SUSPEND, &sa, NULL);
+    sa.sa_handler = vxhSigResume;
+    sigemptyset(&sa.sa_mask);
+    sigaction(VXH_SIG_RESUME, &sa, NULL);
+
+    /* the calling context plays the role of the shell task (priority 1) */
+    param.sched_priority = vxhHostPriority(1);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        vxhRealTime = FALSE;
+        fprintf(stderr, "vxHost: real-time scheduling unavailable, "
+                "running tasks as SCHED_OTHER\n");
+    }
+}
+
+
+/*************************************************************************/
+/*  time helpers                                                         */
+/*                                                                       */
+/*************************************************************************/
+
+static long long vxhMonoNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return vxhTsToNs(&ts);
+}
+
+static void vxhNsToTs(long long ns, struct timespec* ts) {
+    ts->tv_sec  = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static long long vxhTsToNs(const struct timespec* ts) {
+    return (long long)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/* absolute monotonic deadline of a tick timeout, -1 for WAIT_FOREVER */
+static long long vxhTimeoutDeadline(int timeout) {
+    if (timeout == WAIT_FOREVER)
+        return -1;
+    return vxhMonoNow() + (long long)timeout * NSEC_PER_SEC / vxhClkRate;
+}
+
+static int vxhCondWait(pthread_cond_t* cond, pthread_mutex_t* lock,
+        long long deadline) {
+    struct timespec ts;
+    if (deadline < 0)
+        return pthread_cond_wait(cond, lock);
+    vxhNsToTs(deadline, &ts);
+    return pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static void vxhCondInit(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void vxhUnlock(void* lock) {
+    pthread_mutex_unlock((pthread_mutex_t*)lock);
+}
+
+
+/*************************************************************************/
+/*  clocks                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int vxhClockGettime(clockid_t clockId, struct timespec* tp) {
+    if (clockId != CLOCK_REALTIME)
+        return clock_gettime(clockId, tp);
+    vxhNsToTs(vxhMonoNow() + vxhRtOffset, tp);
+    return OK;
+}
+
+int vxhClockSettime(clockid_t clockId, const struct timespec* tp) {
+    if (clockId != CLOCK_REALTIME) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    vxhRtOffset = vxhTsToNs(tp) - vxhMonoNow();
+    return OK;
+}
+
+/* an absolute CLOCK_REALTIME sleep waits on the monotonic clock, shifted
+ * once: a clock_settime while it sleeps does not move it, as with timers */
+int vxhClockNanosleep(clockid_t clockId, int flags,
+        const struct timespec* rqtp, struct timespec* rmtp) {
+    struct timespec ts;
+
+    if (clockId != CLOCK_REALTIME || !(flags & TIMER_ABSTIME))
+        return clock_nanosleep(clockId, flags, rqtp, rmtp);
+    vxhNsToTs(vxhTsToNs(rqtp) - vxhRtOffset, &ts);
+    return clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+int sysClkRateGet(void) {
+    return vxhClkRate;
+}
+
+STATUS sysClkRateSet(int ticksPerSecond) {
+    if (ticksPerSecond < 1)
+        return ERROR;
+    vxhClkRate = ticksPerSecond;
+    return OK;
+}
+
+unsigned long tickGet(void) {
+    return (unsigned long)((vxhMonoNow() - vxhBootTime) * vxhClkRate
+            / NSEC_PER_SEC);
+}
+
+
+/*************************************************************************/
+/*  scheduling policy                                                    */
+/*                                                                       */
+/*************************************************************************/
+
+static int vxhHostPolicy(void) {
+    return (vxhTimeSlice > 0) ? SCHED_RR : SCHED_FIFO;
+}
+
+/* VxWorks 0 (highest) .. 255 (lowest) onto the host real-time range. The
+ * application band from VXH_PRIO_BASE on is mapped one-to-one so that
+ * neighbouring priorities stay distinct; system priorities above the band
+ * share the top levels and the tail of the band shares the lowest one.
+ * With the 99 levels of Linux the band ends at VXH_PRIO_LOWEST */
+static int vxhHostPriority(int vxPriority) {
+    int max = sched_get_priority_max(SCHED_FIFO);
+    int min = sched_get_priority_min(SCHED_FIFO);
+    int prio;
+
+    if (vxPriority < 2)
+        return max;
+    if (vxPriority < VXH_PRIO_BASE)
+        return max - 1;
+    prio = max - 2 - (vxPriority - VXH_PRIO_BASE);
+    return (prio < min) ? min : prio;
+}
+
+/* the host round robin quantum is fixed by the kernel (usually 100 ms), so
+ * any positive slice only switches the tasks to SCHED_RR */
+STATUS kernelTimeSlice(int ticks) {
+    int i;
+    VXH_TCB* tcb;
+    struct sched_param param;
+
+    vxhTimeSlice = ticks;
+    if (!vxhRealTime)
+        return OK;
+    pthread_mutex_lock(&vxhTaskLock);
+    for (i = 0; i < vxhTaskCnt; i++) {
+        tcb = vxhTasks[i];
+        if (tcb->started && !tcb->deleted) {
+            param.sched_priority = vxhHostPriority(tcb->priority);
+            pthread_setschedparam(tcb->thread, vxhHostPolicy(), &param);
+        }
+    }
+    pthread_mutex_unlock(&vxhTaskLock);
+    return OK;
+}
+
+
+/*************************************************************************/
+/*  tasks                                                                */
+/*                                                                       */
+/*************************************************************************/
+
+/* threads not created by taskSpawn() are registered on first use */
+static VXH_TCB* vxhTcbGet(int tid) {
+    VXH_TCB* tcb = NULL;
+    if (tid == 0) {
+        if (vxhSelf == NULL) {
+            vxhSelf = vxhTcbAlloc("tMain", 1, NULL, NULL, 0);
+            if (vxhSelf != NULL) {
+                vxhSelf->thread = pthread_self();
+                vxhSelf->started = TRUE;
+            }
+        }
+        return vxhSelf;
+    }
+    pthread_mutex_lock(&vxhTaskLock);
+    if ((tid > 0) && (tid <= vxhTaskCnt) && !vxhTasks[tid-1]->deleted)
+        tcb = vxhTasks[tid-1];
+    pthread_mutex_unlock(&vxhTaskLock);
+    if (tcb == NULL)
+        errno = S_objLib_OBJ_ID_ERROR;
+    return tcb;
+}
+
+static VXH_TCB* vxhTcbAlloc(const char* name, int priority, FUNCPTR entry,
+        _Vx_usr_arg_t* args, int stackSize) {
+    VXH_TCB* tcb;
+
+    if ((priority < 0) || (priority > 255)) {
+        errno = S_taskLib_ILLEGAL_PRIORITY;
+        return NULL;
+    }
+    if ((tcb = calloc(1, sizeof(VXH_TCB))) == NULL)
+        return NULL;
+    pthread_mutex_lock(&vxhTaskLock);
+    if (vxhTaskCnt >= VXH_MAX_TASKS) {
+        pthread_mutex_unlock(&vxhTaskLock);
+        free(tcb);
+        errno = ENOMEM;
+        return NULL;
+    }
+    vxhTasks[vxhTaskCnt++] = tcb;
+    tcb->id = vxhTaskCnt;
+    pthread_mutex_unlock(&vxhTaskLock);
+
+    if (name != NULL)
+        strncpy(tcb->name, name, VX_TASK_NAME_LENGTH);
+    else
+        snprintf(tcb->name, sizeof(tcb->name), "t%d", tcb->id);
+    tcb->priority = priority;
+    tcb->entry = entry;
+    if (args != NULL)
+        memcpy(tcb->args, args, sizeof(tcb->args));
+    tcb->stackSize = (stackSize < VXH_MIN_STACK) ? VXH_MIN_STACK : stackSize;
+    pthread_mutex_init(&tcb->lock, NULL);
+    vxhCondInit(&tcb->resume);
+    return tcb;
+}
+
+static STATUS vxhTaskStart(VXH_TCB* tcb) {
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t set;
+    int rc;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, tcb->stackSize);
+    /* pinned before it runs, so timers it creates inherit the affinity */
+    vxhAffinityMask(tcb, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    if (vxhRealTime) {
+        param.sched_priority = vxhHostPriority(tcb->priority);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, vxhHostPolicy());
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    tcb->suspended = 0;
+    tcb->started = TRUE;
+    rc = pthread_create(&tcb->thread, &attr, vxhTaskWrapper, tcb);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        tcb->started = FALSE;
+        errno = rc;
+        return ERROR;
+    }
+    return OK;
+}
+
+static void vxhAffinityMask(VXH_TCB* tcb, cpu_set_t* set) {
+    unsigned int cpu;
+
+    CPU_ZERO(set);
+    for (cpu = 0; cpu < vxCpuConfiguredGet(); cpu++) {
+        if (CPUSET_ISZERO(tcb->affinity) || CPUSET_ISSET(tcb->affinity, cpu))
+            CPU_SET(cpu, set);
+    }
+}
+
+/* cancel the thread of a task and release the timers it owns */
+static void vxhTaskStop(VXH_TCB* tcb) {
+    while (tcb->timers != NULL)
+        vxhTimerDelete((timer_t)tcb->timers);
+    if (!tcb->started)
+        return;
+    pthread_cancel(tcb->thread);
+    if (tcb->suspended)
+        pthread_kill(tcb->thread, VXH_SIG_RESUME);
+    pthread_join(tcb->thread, NULL);
+    tcb->started = FALSE;
+}
+
+static void* vxhTaskWrapper(void* arg) {
+    VXH_TCB* tcb = arg;
+    _Vx_usr_arg_t* a = tcb->args;
+
+    vxhSelf = tcb;
+    ((void (*)(_Vx_usr_arg_t, _Vx_usr_arg_t, _Vx_usr_arg_t, _Vx_usr_arg_t,
+               _Vx_usr_arg_t, _Vx_usr_arg_t, _Vx_usr_arg_t, _Vx_usr_arg_t,
+               _Vx_usr_arg_t, _Vx_usr_arg_t))tcb->entry)
+        (a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+    taskDelete(0);      /* returning ends the task, as in VxWorks */
+    return NULL;
+}
+
+static void vxhSigSuspend(int sig) {
+    sigset_t mask;
+    (void)sig;
+    pthread_sigmask(SIG_BLOCK, NULL, &mask);
+    sigdelset(&mask, VXH_SIG_RESUME);
+    while (vxhSelf != NULL && vxhSelf->suspended)
+        sigsuspend(&mask);
+}
+
+static void vxhSigResume(int sig) {
+    (void)sig;
+}
+
+int taskCreate(char* name, int priority, int options, int stackSize,
+        FUNCPTR entryPt, _Vx_usr_arg_t arg1, _Vx_usr_arg_t arg2,
+        _Vx_usr_arg_t arg3, _Vx_usr_arg_t arg4, _Vx_usr_arg_t arg5,
+        _Vx_usr_arg_t arg6, _Vx_usr_arg_t arg7, _Vx_usr_arg_t arg8,
+        _Vx_usr_arg_t arg9, _Vx_usr_arg_t arg10) {
+    _Vx_usr_arg_t args[VXH_MAX_ARGS] = {
+        arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10 };
+    VXH_TCB* tcb;
+    (void)options;
+
+    tcb = vxhTcbAlloc(name, priority, entryPt, args, stackSize);
+    return (tcb == NULL) ? ERROR : tcb->id;
+}
+
+int taskSpawn(char* name, int priority, int options, int stackSize,
+        FUNCPTR entryPt, _Vx_usr_arg_t arg1, _Vx_usr_arg_t arg2,
+        _Vx_usr_arg_t arg3, _Vx_usr_arg_t arg4, _Vx_usr_arg_t arg5,
+        _Vx_usr_arg_t arg6, _Vx_usr_arg_t arg7, _Vx_usr_arg_t arg8,
+        _Vx_usr_arg_t arg9, _Vx_usr_arg_t arg10) {
+    int tid;
+
+    tid = taskCreate(name, priority, options, stackSize, entryPt, arg1, arg2,
+            arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10);
+    if (tid == ERROR)
+        return ERROR;
+    if (taskActivate(tid) == ERROR)
+        return ERROR;
+    return tid;
+}
+
+/* activating a task that already runs resumes it, as on the lecture target */
+STATUS taskActivate(int tid) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if (!tcb->started)
+        return vxhTaskStart(tcb);
+    return taskResume(tid);
+}
+
+STATUS taskDelete(int tid) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if (tcb == vxhSelf) {
+        tcb->deleted = TRUE;
+        while (tcb->timers != NULL)
+            vxhTimerDelete((timer_t)tcb->timers);
+        pthread_detach(pthread_self());
+        pthread_exit(NULL);
+    }
+    vxhTaskStop(tcb);
+    tcb->deleted = TRUE;
+    return OK;
+}
+
+STATUS taskSuspend(int tid) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if (!tcb->started) {
+        tcb->suspended = 1;
+        return OK;
+    }
+    if (tcb == vxhSelf && pthread_equal(tcb->thread, pthread_self())) {
+        pthread_mutex_lock(&tcb->lock);
+        pthread_cleanup_push(vxhUnlock, &tcb->lock);
+        tcb->suspended = 1;
+        while (tcb->suspended)
+            pthread_cond_wait(&tcb->resume, &tcb->lock);
+        pthread_cleanup_pop(1);
+        return OK;
+    }
+    tcb->suspended = 1;
+    pthread_kill(tcb->thread, VXH_SIG_SUSPEND);
+    return OK;
+}
+
+STATUS taskResume(int tid) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    pthread_mutex_lock(&tcb->lock);
+    tcb->suspended = 0;
+    pthread_cond_broadcast(&tcb->resume);
+    pthread_mutex_unlock(&tcb->lock);
+    if (tcb->started)
+        pthread_kill(tcb->thread, VXH_SIG_RESUME);
+    return OK;
+}
+
+/* the task is restarted with its current priority and original arguments */
+STATUS taskRestart(int tid) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if (tcb == vxhSelf || tcb->entry == NULL) {
+        errno = S_taskLib_ILLEGAL_OPERATION;
+        return ERROR;
+    }
+    vxhTaskStop(tcb);
+    return vxhTaskStart(tcb);
+}
+
+STATUS taskDelay(int ticks) {
+    struct timespec ts;
+
+    if (ticks <= 0) {
+        sched_yield();
+        pthread_testcancel();
+        return OK;
+    }
+    vxhNsToTs(vxhTimeoutDeadline(ticks), &ts);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    return OK;
+}
+
+STATUS taskPrioritySet(int tid, int newPriority) {
+    VXH_TCB* tcb;
+    struct sched_param param;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if ((newPriority < 0) || (newPriority > 255)) {
+        errno = S_taskLib_ILLEGAL_PRIORITY;
+        return ERROR;
+    }
+    tcb->priority = newPriority;
+    if (vxhRealTime && tcb->started) {
+        param.sched_priority = vxhHostPriority(newPriority);
+        pthread_setschedparam(tcb->thread, vxhHostPolicy(), &param);
+    }
+    return OK;
+}
+
+STATUS taskPriorityGet(int tid, int* pPriority) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    *pPriority = tcb->priority;
+    return OK;
+}
+
+/* CPUs that do not exist on the host are rejected with EINVAL */
+STATUS taskCpuAffinitySet(int tid, cpuset_t affinity) {
+    VXH_TCB* tcb;
+    cpu_set_t set;
+    int rc;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    if (!CPUSET_ISZERO(affinity) && (affinity & ~vxCpuEnabledGet()) != 0) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    tcb->affinity = affinity;
+    vxhAffinityMask(tcb, &set);
+    if (tcb->started
+            && (rc = pthread_setaffinity_np(tcb->thread, sizeof(set), &set)) != 0) {
+        errno = rc;
+        return ERROR;
+    }
+    return OK;
+}
+
+STATUS taskCpuAffinityGet(int tid, cpuset_t* pAffinity) {
+    VXH_TCB* tcb;
+
+    if ((tcb = vxhTcbGet(tid)) == NULL)
+        return ERROR;
+    *pAffinity = tcb->affinity;
+    return OK;
+}
+
+STATUS taskIdVerify(int tid) {
+    return (vxhTcbGet(tid) == NULL) ? ERROR : OK;
+}
+
+BOOL taskIsSuspended(int tid) {
+    VXH_TCB* tcb = vxhTcbGet(tid);
+    return (tcb != NULL) && (!tcb->started || tcb->suspended);
+}
+
+BOOL taskIsReady(int tid) {
+    VXH_TCB* tcb = vxhTcbGet(tid);
+    return (tcb != NULL) && tcb->started && !tcb->suspended;
+}
+
+int taskIdSelf(void) {
+    VXH_TCB* tcb = vxhTcbGet(0);
+    return (tcb == NULL) ? ERROR : tcb->id;
+}
+
+char* taskName(int tid) {
+    VXH_TCB* tcb = vxhTcbGet(tid);
+    return (tcb == NULL) ? NULL : tcb->name;
+}
+
+
+/*************************************************************************/
+/*  CPUs                                                                 */
+/*                                                                       */
+/*************************************************************************/
+
+unsigned int vxCpuConfiguredGet(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        return 1;
+    return (n > 32) ? 32 : (unsigned int)n;
+}
+
+cpuset_t vxCpuEnabledGet(void) {
+    unsigned int n = vxCpuConfiguredGet();
+    return (n >= 32) ? ~0u : (1u << n) - 1;
+}
+
+
+/*************************************************************************/
+/*  semaphores                                                           */
+/*                                                                       */
+/*************************************************************************/
+
+static SEM_ID vxhSemCreate(int type, int count) {
+    SEM_ID sem;
+
+    if ((sem = calloc(1, sizeof(struct semaphore))) == NULL)
+        return NULL;
+    pthread_mutex_init(&sem->lock, NULL);
+    vxhCondInit(&sem->cond);
+    sem->type = type;
+    sem->count = count;
+    return sem;
+}
+
+SEM_ID semBCreate(int options, SEM_B_STATE initialState) {
+    (void)options;
+    return vxhSemCreate(SEM_TYPE_BINARY, (initialState == SEM_FULL) ? 1 : 0);
+}
+
+SEM_ID semCCreate(int options, int initialCount) {
+    (void)options;
+    return vxhSemCreate(SEM_TYPE_COUNTING, initialCount);
+}
+
+/* recursive, owned by the task that took it; SEM_INVERSION_SAFE makes it
+ * a priority inheritance mutex of the host, which boosts the owner's
+ * real-time priority. As in VxWorks it requires SEM_Q_PRIORITY */
+SEM_ID semMCreate(int options) {
+    pthread_mutexattr_t attr;
+    SEM_ID sem;
+
+    if ((options & SEM_INVERSION_SAFE) && !(options & SEM_Q_PRIORITY)) {
+        errno = S_semLib_INVALID_OPTION;
+        return NULL;
+    }
+    if ((sem = vxhSemCreate(SEM_TYPE_MUTEX, 1)) == NULL)
+        return NULL;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    if (options & SEM_INVERSION_SAFE)
+        pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&sem->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return sem;
+}
+
+/* unlike VxWorks the host cannot delete a mutex that is still taken, it
+ * is left as it is and reported */
+STATUS semDelete(SEM_ID semId) {
+    if (semId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    if (semId->type == SEM_TYPE_MUTEX
+            && pthread_mutex_destroy(&semId->mutex) == EBUSY) {
+        errno = S_objLib_OBJ_UNAVAILABLE;
+        return ERROR;
+    }
+    pthread_mutex_destroy(&semId->lock);
+    pthread_cond_destroy(&semId->cond);
+    free(semId);
+    return OK;
+}
+
+STATUS semTake(SEM_ID semId, int timeout) {
+    /* volatile: both live across the setjmp of pthread_cleanup_push */
+    volatile long long deadline = vxhTimeoutDeadline(timeout);
+    volatile STATUS status = OK;
+
+    if (semId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    if (semId->type == SEM_TYPE_MUTEX)
+        return vxhMutexTake(semId, timeout);
+    pthread_mutex_lock(&semId->lock);
+    pthread_cleanup_push(vxhUnlock, &semId->lock);
+    while (semId->count == 0) {
+        if (timeout == NO_WAIT) {
+            errno = S_objLib_OBJ_UNAVAILABLE;
+            status = ERROR;
+            break;
+        }
+        if (vxhCondWait(&semId->cond, &semId->lock, deadline) == ETIMEDOUT) {
+            errno = S_objLib_OBJ_TIMEOUT;
+            status = ERROR;
+            break;
+        }
+    }
+    if (status == OK)
+        semId->count--;
+    pthread_cleanup_pop(1);
+    return status;
+}
+
+STATUS semGive(SEM_ID semId) {
+    if (semId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    if (semId->type == SEM_TYPE_MUTEX) {
+        if (pthread_mutex_unlock(&semId->mutex) != 0) {
+            errno = S_semLib_INVALID_OPERATION;   /* not the owner */
+            return ERROR;
+        }
+        return OK;
+    }
+    pthread_mutex_lock(&semId->lock);
+    if (semId->type == SEM_TYPE_COUNTING || semId->count == 0)
+        semId->count++;
+    pthread_cond_signal(&semId->cond);
+    pthread_mutex_unlock(&semId->lock);
+    return OK;
+}
+
+
+/* locking a mutex is no cancellation point, so the wait is cut into
+ * slices for taskDelete to get through. Kernels before 5.14 refuse a
+ * monotonic timeout on priority inheritance mutexes; those slices are
+ * timed against the realtime clock instead, which only stretches a
+ * slice when the clock is stepped */
+static STATUS vxhMutexTake(SEM_ID semId, int timeout) {
+    static int noClockLock;
+    long long deadline = vxhTimeoutDeadline(timeout), until;
+    struct timespec ts;
+    int rc;
+
+    if (timeout == NO_WAIT)
+        rc = pthread_mutex_trylock(&semId->mutex);
+    else {
+        while (1) {
+            until = vxhMonoNow() + VXH_CANCEL_POLL;
+            if (deadline >= 0 && deadline < until)
+                until = deadline;
+            if (!noClockLock) {
+                vxhNsToTs(until, &ts);
+                rc = pthread_mutex_clocklock(&semId->mutex, CLOCK_MONOTONIC,
+                        &ts);
+                if (rc == EINVAL)
+                    noClockLock = 1;
+            }
+            if (noClockLock) {
+                clock_gettime(CLOCK_REALTIME, &ts);
+                vxhNsToTs((long long)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec
+                        + until - vxhMonoNow(), &ts);
+                rc = pthread_mutex_timedlock(&semId->mutex, &ts);
+            }
+            if (rc != ETIMEDOUT || until == deadline)
+                break;
+            pthread_testcancel();
+        }
+    }
+    if (rc == 0)
+        return OK;
+    errno = (rc == EBUSY) ? S_objLib_OBJ_UNAVAILABLE
+          : (rc == ETIMEDOUT) ? S_objLib_OBJ_TIMEOUT : S_objLib_OBJ_ID_ERROR;
+    return ERROR;
+}
+
+
+/*************************************************************************/
+/*  message queues                                                       */
+/*                                                                       */
+/*************************************************************************/
+
+MSG_Q_ID msgQCreate(int maxMsgs, int maxMsgLength, int options) {
+    MSG_Q_ID q;
+    (void)options;
+
+    if ((maxMsgs < 1) || (maxMsgLength < 0))
+        return NULL;
+    if ((q = calloc(1, sizeof(struct msg_q))) == NULL)
+        return NULL;
+    q->length = calloc(maxMsgs, sizeof(unsigned int));
+    q->buf = malloc((size_t)maxMsgs * (maxMsgLength ? maxMsgLength : 1));
+    if (q->length == NULL || q->buf == NULL) {
+        free(q->length);
+        free(q->buf);
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    vxhCondInit(&q->notEmpty);
+    vxhCondInit(&q->notFull);
+    q->maxMsgs = maxMsgs;
+    q->maxMsgLength = maxMsgLength;
+    return q;
+}
+
+STATUS msgQDelete(MSG_Q_ID msgQId) {
+    if (msgQId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    pthread_mutex_destroy(&msgQId->lock);
+    pthread_cond_destroy(&msgQId->notEmpty);
+    pthread_cond_destroy(&msgQId->notFull);
+    free(msgQId->length);
+    free(msgQId->buf);
+    free(msgQId);
+    return OK;
+}
+
+STATUS msgQSend(MSG_Q_ID msgQId, char* buffer, unsigned int nBytes,
+        int timeout, int priority) {
+    volatile long long deadline = vxhTimeoutDeadline(timeout);
+    volatile STATUS status = OK;
+    int slot;
+
+    if (msgQId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    if (nBytes > (unsigned int)msgQId->maxMsgLength) {
+        errno = S_msgQLib_INVALID_MSG_LENGTH;
+        return ERROR;
+    }
+    pthread_mutex_lock(&msgQId->lock);
+    pthread_cleanup_push(vxhUnlock, &msgQId->lock);
+    while (msgQId->count == msgQId->maxMsgs) {
+        if (timeout == NO_WAIT) {
+            errno = S_objLib_OBJ_UNAVAILABLE;
+            status = ERROR;
+            break;
+        }
+        if (vxhCondWait(&msgQId->notFull, &msgQId->lock, deadline)
+                == ETIMEDOUT) {
+            errno = S_objLib_OBJ_TIMEOUT;
+            status = ERROR;
+            break;
+        }
+    }
+    if (status == OK) {
+        if (priority == MSG_PRI_URGENT) {
+            msgQId->head = (msgQId->head + msgQId->maxMsgs - 1) % msgQId->maxMsgs;
+            slot = msgQId->head;
+        }
+        else {
+            slot = (msgQId->head + msgQId->count) % msgQId->maxMsgs;
+        }
+        memcpy(msgQId->buf + (size_t)slot * msgQId->maxMsgLength, buffer, nBytes);
+        msgQId->length[slot] = nBytes;
+        msgQId->count++;
+        pthread_cond_signal(&msgQId->notEmpty);
+    }
+    pthread_cleanup_pop(1);
+    return status;
+}
+
+int msgQReceive(MSG_Q_ID msgQId, char* buffer, unsigned int maxNBytes,
+        int timeout) {
+    volatile long long deadline = vxhTimeoutDeadline(timeout);
+    volatile int nBytes = ERROR;
+    int slot;
+
+    if (msgQId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    pthread_mutex_lock(&msgQId->lock);
+    pthread_cleanup_push(vxhUnlock, &msgQId->lock);
+    while (msgQId->count == 0) {
+        if (timeout == NO_WAIT) {
+            errno = S_objLib_OBJ_UNAVAILABLE;
+            break;
+        }
+        if (vxhCondWait(&msgQId->notEmpty, &msgQId->lock, deadline)
+                == ETIMEDOUT) {
+            errno = S_objLib_OBJ_TIMEOUT;
+            break;
+        }
+    }
+    if (msgQId->count > 0) {
+        slot = msgQId->head;
+        nBytes = msgQId->length[slot];
+        if ((unsigned int)nBytes > maxNBytes)
+            nBytes = maxNBytes;
+        memcpy(buffer, msgQId->buf + (size_t)slot * msgQId->maxMsgLength, nBytes);
+        msgQId->head = (msgQId->head + 1) % msgQId->maxMsgs;
+        msgQId->count--;
+        pthread_cond_signal(&msgQId->notFull);
+    }
+    pthread_cleanup_pop(1);
+    return nBytes;
+}
+
+int msgQNumMsgs(MSG_Q_ID msgQId) {
+    int count;
+
+    if (msgQId == NULL) {
+        errno = S_objLib_OBJ_ID_ERROR;
+        return ERROR;
+    }
+    pthread_mutex_lock(&msgQId->lock);
+    count = msgQId->count;
+    pthread_mutex_unlock(&msgQId->lock);
+    return count;
+}
+
+
+/*************************************************************************/
+/*  timers                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int vxhTimerCreate(clockid_t clockId, struct sigevent* evp, timer_t* pTimer) {
+    VXH_TIMER* t;
+    VXH_TCB* owner;
+    pthread_attr_t attr;
+    struct sched_param param;
+    int rc;
+    (void)evp;
+
+    if ((clockId != CLOCK_REALTIME) && (clockId != CLOCK_MONOTONIC)) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    if ((owner = vxhTcbGet(0)) == NULL)
+        return ERROR;
+    if ((t = calloc(1, sizeof(VXH_TIMER))) == NULL)
+        return ERROR;
+    t->clock = clockId;
+    t->owner = owner;
+    pthread_mutex_init(&t->lock, NULL);
+    vxhCondInit(&t->cond);
+
+    /* the handler thread runs at the priority of the creating task */
+    pthread_attr_init(&attr);
+    if (vxhRealTime) {
+        param.sched_priority = vxhHostPriority(owner->priority);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    rc = pthread_create(&t->thread, &attr, vxhTimerThread, t);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        free(t);
+        errno = rc;
+        return ERROR;
+    }
+
+    pthread_mutex_lock(&vxhTaskLock);
+    t->next = owner->timers;
+    owner->timers = t;
+    pthread_mutex_unlock(&vxhTaskLock);
+    *pTimer = (timer_t)t;
+    return OK;
+}
+
+int vxhTimerDelete(timer_t timerId) {
+    VXH_TIMER* t = (VXH_TIMER*)timerId;
+    VXH_TIMER** pp;
+
+    if (t == NULL) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    pthread_mutex_lock(&vxhTaskLock);
+    for (pp = &t->owner->timers; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&vxhTaskLock);
+
+    pthread_mutex_lock(&t->lock);
+    t->deleted = TRUE;
+    /* deleted from its own handler: the timer thread cleans up itself */
+    if (pthread_equal(t->thread, pthread_self())) {
+        t->detached = TRUE;
+        pthread_mutex_unlock(&t->lock);
+        pthread_detach(t->thread);
+        return OK;
+    }
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t);
+    return OK;
+}
+
+int timer_connect(timer_t timerId, VOIDFUNCPTR routine, _Vx_usr_arg_t arg) {
+    VXH_TIMER* t = (VXH_TIMER*)timerId;
+
+    if (t == NULL) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    pthread_mutex_lock(&t->lock);
+    t->routine = routine;
+    t->arg = arg;
+    pthread_mutex_unlock(&t->lock);
+    return OK;
+}
+
+int vxhTimerSettime(timer_t timerId, int flags,
+        const struct itimerspec* value, struct itimerspec* ovalue) {
+    VXH_TIMER* t = (VXH_TIMER*)timerId;
+    long long expiry;
+
+    if (t == NULL || value == NULL) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    if (ovalue != NULL)
+        vxhTimerGettime(timerId, ovalue);
+
+    expiry = vxhTsToNs(&value->it_value);
+    if (expiry != 0) {
+        if (!(flags & TIMER_ABSTIME))
+            expiry += vxhMonoNow();
+        else if (t->clock == CLOCK_REALTIME)
+            expiry -= vxhRtOffset;
+        /* 0 is reserved for a disarmed timer */
+        if (expiry <= 0)
+            expiry = 1;
+    }
+    pthread_mutex_lock(&t->lock);
+    t->expiry = expiry;
+    t->interval = vxhTsToNs(&value->it_interval);
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return OK;
+}
+
+int vxhTimerGettime(timer_t timerId, struct itimerspec* value) {
+    VXH_TIMER* t = (VXH_TIMER*)timerId;
+    long long left = 0;
+
+    if (t == NULL || value == NULL) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    pthread_mutex_lock(&t->lock);
+    if (t->expiry != 0) {
+        left = t->expiry - vxhMonoNow();
+        if (left < 1)
+            left = 1;
+    }
+    vxhNsToTs(left, &value->it_value);
+    vxhNsToTs(t->interval, &value->it_interval);
+    pthread_mutex_unlock(&t->lock);
+    return OK;
+}
+
+int timer_cancel(timer_t timerId) {
+    struct itimerspec value;
+
+    memset(&value, 0, sizeof(value));
+    return vxhTimerSettime(timerId, 0, &value, NULL);
+}
+
+static void* vxhTimerThread(void* arg) {
+    VXH_TIMER* t = arg;
+    long long now;
+
+    /* the handler executes in the context of the owning task */
+    vxhSelf = t->owner;
+    pthread_mutex_lock(&t->lock);
+    while (!t->deleted) {
+        if (t->expiry == 0) {
+            pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+        now = vxhMonoNow();
+        if (now < t->expiry) {
+            vxhCondWait(&t->cond, &t->lock, t->expiry);
+            continue;
+        }
+        t->expiry = (t->interval > 0) ? t->expiry + t->interval : 0;
+        pthread_mutex_unlock(&t->lock);
+        if (t->routine != NULL)
+            t->routine((timer_t)t, t->arg);
+        pthread_mutex_lock(&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (t->detached) {
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->cond);
+        free(t);
+    }
+    return NULL;
+}
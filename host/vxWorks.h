@@ -0,0 +1,32 @@
+/*************************************************************************/
+/*  vxWorks.h                                                            */
+/*                                                                       */
+/*  host emulation: VxWorks base types and constants                     */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCvxWorksh
+#define __INCvxWorksh
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int      STATUS;
+typedef int      BOOL;
+typedef intptr_t _Vx_usr_arg_t;
+
+typedef int  (*FUNCPTR)();
+typedef void (*VOIDFUNCPTR)();
+
+#define OK    0
+#define ERROR (-1)
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define NO_WAIT      0
+#define WAIT_FOREVER (-1)
+
+#endif /* __INCvxWorksh */
@@ -10,13 +10,20 @@
 #include "vxWorks.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "string.h"
+#include "math.h"
 #include "semLib.h"
+#include "msgQLib.h"
 #include "taskLib.h"
+#include "vxCpuLib.h"
 #include "kernelLib.h"
 #include "tickLib.h"
 #include "time.h"
 #include "sigLib.h"
 #include "errno.h"
+#include "traceLib.h"
+#include "wheelLib.h"
+#include "delayLib.h"
 
 /* defines */
 #define STACK_SIZE    20000
@@ -28,8 +35,41 @@
 #define MAX_COMP_TIME 100
 #define MIN_MSG       2
 #define MAX_MSG       100
-#define TIMESLICE     6 // set time slice to 100 ms
-#define MAX_MSG_LEN   34
+#define MAX_SOURCES   31   // aperiodic producers
+#define MAX_QUEUES    (MAX_SOURCES + 1)
+#define MAX_QUANTUM   MAX_MSG
+#define MAX_WORKERS   16
+#define DEQUE_SIZE    128  // power of 2, holds a batch of MAX_MSG
+#define SPILL_DEPTH   MAX_DEPTH
+#define HIST_SUB_BITS 7    // buckets per power of 2: 2^7, within 1/128
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BITS     42   // values up to 2^42 ns, over an hour
+#define HIST_BUCKETS  ((HIST_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define TIMESLICE     100000000LL  // ns, time slice of 100 ms
+#define MSG_DATA      256  // payload bytes per message
+#define CACHE_LINE    64
+
+/* transports between producers and consumer */
+#define TRANSPORT_MSGQ 0   // kernel message queue
+#define TRANSPORT_SPSC 1   // lock-free ring, single producer
+#define TRANSPORT_MPSC 2   // lock-free ring, multiple producers
+
+/* what a send to a full queue does, it never blocks */
+#define OVERFLOW_DROP_NEWEST 0  // drop the message sent
+#define OVERFLOW_DROP_OLDEST 1  // drop the oldest queued message instead
+#define OVERFLOW_COALESCE    2  // hold back the newest, replacing older ones
+#define OVERFLOW_SPILL       3  // hold back in a secondary buffer
+
+/* inter-arrival distributions of the aperiodic producers */
+#define ARRIVAL_UNIFORM     0   // uniform between the bounds
+#define ARRIVAL_EXPONENTIAL 1   // Poisson, mean halfway between the bounds
+#define ARRIVAL_MMPP        2   // bursts at the lower, lulls at the upper bound
+#define MMPP_DWELL          5   // mean arrivals per stay in a state
+
+/* policies of the consumer across its queues */
+#define POLICY_DRR      0   // deficit round-robin, quantum messages per round
+#define POLICY_PRIORITY 1   // strict priority, lowest number first
+#define POLICY_EDF      2   // earliest message deadline first
 
 #define TYPE_PERIODIC  'P'
 #define TYPE_APERIODIC 'A'
@@ -37,27 +77,272 @@
 #define STR_APERIODIC  "APERIODIC"
 
 #define IDENT "                                 "
+
+/* trace events, formats in ev_formats */
+#define EV_SENT      0
+#define EV_DROPPED   1
+#define EV_PROCESSED 2
+#define EV_COALESCED 3
+#define EV_DONE      4
+#define EV_CNT       5
+#define TIMELINE     "prodCons.json"  // Chrome trace-event file
 #define true  1
 #define false 0
 
-/* task IDs */
-int tidProdPeriodic;			
-int tidProdAperiodic;			
-int tidConsumer;
+typedef int bool;
+
+/* message buffer, filled in place by the producer and passed by handle */
+typedef struct message {
+    unsigned int next;      /* pool: next free message, index + 1 */
+    char type;
+    int  source;            /* index of the queue it was sent to */
+    int  seq;
+    int  ticket;            /* order of service within its queue */
+    int  coalesced;         /* earlier messages it replaced */
+    long long stamp;        /* enqueue time, CLOCK_MONOTONIC ns */
+    long long deadline;     /* absolute, ns */
+    int  len;
+    char data[MSG_DATA];    /* payload, len bytes used */
+} t_msg;
+
+/* preallocated messages; the free ones form a stack linked by index. Its
+ * top packs the index with a tag that changes on every update, so a CAS
+ * with a stale top fails even if the same message is on top again (ABA) */
+typedef struct msg_pool {
+    t_msg* msg;
+    int cnt;
+    volatile unsigned long long top;    /* tag << 32 | index + 1, 0: empty */
+} t_pool;
+
+typedef struct ring_slot {
+    volatile unsigned int seq;  /* MPSC: position the slot is ready for */
+    t_msg* msg;
+} t_slot;
+
+/* bounded ring of 2^n slots. The consumer owns head and the producers own
+ * tail, each on its own cache line next to a cached copy of the other
+ * index, so the other side's line is only read when the ring looks empty
+ * or full. A single producer publishes with a release store of tail and
+ * never waits; several producers claim slots by CAS on tail and publish
+ * through the sequence number of the slot */
+typedef struct ring {
+    char pad0[CACHE_LINE];
+    volatile unsigned int head;
+    unsigned int tail_cache;
+    char pad1[CACHE_LINE];
+    volatile unsigned int tail;
+    unsigned int head_cache;    /* SPSC only */
+    char pad2[CACHE_LINE];
+    unsigned int mask;
+    bool mpsc;
+    bool shared;            /* head claimed by CAS, a producer may evict */
+    t_slot* slot;
+} t_ring;
+
+/* wakeup of a consumer blocked on its queues; producers only give the
+ * semaphore when the consumer announced that it is about to sleep */
+typedef struct wakeup {
+    volatile int waiting;
+    SEM_ID sem;
+} t_wakeup;
+
+/* log-linear histogram of ns values (HDR style): values below HIST_SUB
+ * have a bucket each, above that every power of 2 is split into HIST_SUB
+ * buckets. Recording is an atomic increment, from any number of tasks */
+typedef struct histogram {
+    volatile unsigned int cnt[HIST_BUCKETS];
+    volatile long long total;
+    volatile long long max;
+} t_hist;
+
+/* producer-consumer queue over one of the transports. The backlog counts
+ * messages sent and not yet taken; it is raised after the message is
+ * published, so the consumer never looks into a queue whose backlog is 0.
+ * Messages held back on overflow stay on the producer side; they go out
+ * on its next send, or by its flush timer when the consumer makes room */
+typedef struct prod_queue {
+    int transport;
+    MSG_Q_ID qid;
+    t_ring* ring;
+    t_wakeup* wakeup;       /* of the consumer, shared by its queues */
+    char name[16];
+    char type;
+    int index;
+    int quantum;            /* DRR: messages per round */
+    int prio;               /* strict priority */
+    long long deadline;     /* EDF: relative deadline of its messages, ns */
+    bool ordered;           /* its messages are processed one at a time */
+    int overflow;
+
+    /* producer side */
+    char pad0[CACHE_LINE];
+    volatile int backlog;
+    int backlog_max;
+    int seq;
+    t_msg* pending;         /* coalesce: newest message held back */
+    t_msg** spill;          /* spill: messages held back, oldest first */
+    int spill_head;
+    int spill_cnt;
+    int spill_max;
+    int dropped;
+    int coalesced;
+    volatile int held;      /* messages are held back */
+    WHEEL_TIMER flush;      /* on the producer wheel, started by the consumer */
+
+    /* consumer side */
+    char pad1[CACHE_LINE];
+    int deficit;            /* DRR: messages left in this round */
+    t_msg* head;            /* EDF: message taken ahead of its service */
+    int batch_served;
+    long long served;
+    long long skipped;      /* batches that passed it over with a backlog */
+    long long wait_sum;     /* ns from send to service */
+    long long wait_max;
+    int ticket;             /* next ticket handed out */
+    volatile int done;      /* ticket whose processing may start */
+    t_hist latency;         /* send to receive by a worker */
+} t_queue;
+
+/* queues served by one consumer; with strict priority they are kept in
+ * the order they are served in */
+typedef struct queue_set {
+    t_queue* queue[MAX_QUEUES];
+    int cnt;
+    int policy;
+    int next;               /* DRR: queue whose round is under way */
+    t_wakeup wakeup;
+} t_qset;
+
+/* work-stealing deque of a consumer worker (Chase-Lev). The owner pushes
+ * and pops at the bottom, other workers steal from the top; only a race
+ * for the last message costs a CAS of the owner */
+typedef struct deque {
+    char pad0[CACHE_LINE];
+    volatile long long top;
+    char pad1[CACHE_LINE];
+    volatile long long bottom;
+    char pad2[CACHE_LINE];
+    t_msg* buf[DEQUE_SIZE];
+} t_deque;
+
+typedef struct worker {
+    t_deque deque;
+    int id;
+    SEM_ID turn;                    /* given when its ordered message is next */
+    t_queue* volatile wait_queue;   /* queue it waits on, or NULL */
+    int wait_ticket;
+    long long processed;
+    long long stolen;
+} t_worker;
+
+/* arrival process of an aperiodic producer, owned by its timer handler */
+typedef struct arrival {
+    t_queue* queue;
+    WHEEL_TIMER timer;
+    int dist;
+    long long low;              /* ns */
+    long long up;               /* ns */
+    long long next;             /* absolute time of the next arrival, ns */
+    unsigned long long rng;     /* xorshift64* state, never 0 */
+    bool burst;                 /* MMPP: in the bursty state */
+    long long dwell;            /* MMPP: ns left in the state */
+} t_arrival;
 
-/* queue IDs */
-MSG_Q_ID qidPeriodic;
-MSG_Q_ID qidAperiodic;
+/* task IDs */
+int tidConsumer[MAX_WORKERS];
+
+/* the producers are timers on one wheel, run by its task tProducers */
+WHEEL_ID producers;
+WHEEL_TIMER periodicTimer;
+t_arrival arrivals[MAX_SOURCES];
+
+/* queues, periodic producer first */
+t_queue queues[MAX_QUEUES];
+int queueCnt;
+t_qset consumerSet;
+t_pool msgPool;
+
+/* consumer workers; the one holding the dispatch token receives from the
+ * queue set, the idle ones sleep on semIdle */
+t_worker workers[MAX_WORKERS];
+int workerCnt;
+volatile int dispatchToken;
+volatile int idleWorkers;
+SEM_ID semIdle;
+DELAY_HIST computeDelays = DELAY_HIST_INIT("consumer computation");
+
+/* producers and consumers log through the trace rings */
+const char* const ev_formats[EV_CNT] = {
+    [EV_SENT]      = "%s: message #%03d @ %03ds.\n",
+    [EV_DROPPED]   = "%s: message #%03d dropped @ %03ds.\n",
+    [EV_PROCESSED] = IDENT"CONSUMER %d: message #%03d from %s @ %03ds, %lldus.\n",
+    [EV_COALESCED] = IDENT"CONSUMER %d: message #%03d (+%d) from %s @ %03ds, %lldus.\n",
+    [EV_DONE]      = NULL,
+};
+
+/* timeline: sends on the track of their queue, a slice per message on
+ * the track of the worker that processed it */
+const TRACE_SPAN ev_spans[EV_CNT] = {
+    [EV_SENT]      = { 'i',  0, NULL, "sent" },
+    [EV_DROPPED]   = { 'i',  0, NULL, "dropped" },
+    [EV_PROCESSED] = { 'B', -1, NULL, "message" },
+    [EV_COALESCED] = { 'B', -1, NULL, "message" },
+    [EV_DONE]      = { 'E', -1, NULL, "message" },
+};
 
 /* function declarations */
 void prodPeriodic(int);
-void prodAperiodic(int, int);
-void consumer(int, int);
-void timerHandlerPeriodic(timer_t, int*);
-void timerHandlerAperiodic(timer_t, int*);
-int random_in_range (unsigned int, unsigned int);
-
-typedef int bool;
+void prodAperiodic(int, int, int, int, int);
+void consumer(int, int, int);
+void timerHandlerPeriodic(WHEEL_TIMER*, t_queue*);
+void timerHandlerAperiodic(WHEEL_TIMER*, t_arrival*);
+unsigned long long splitmix64(unsigned long long*);
+unsigned long long rng_next(unsigned long long*);
+double rng_uniform(unsigned long long*);
+double rng_exponential(unsigned long long*, double);
+long long arrival_next(t_arrival*);
+STATUS arrival_arm(t_arrival*);
+STATUS queue_create(t_queue*, int, int, int);
+void queue_delete(t_queue*);
+STATUS queue_send(t_queue*, t_msg*);
+void queue_flush(t_queue*);
+void queue_flush_timer(WHEEL_TIMER*, t_queue*);
+STATUS queue_put(t_queue*, t_msg*);
+STATUS queue_evict(t_queue*);
+void queue_wake(t_queue*);
+int queue_drain(t_queue*, t_msg**, int);
+int queue_take(t_queue*, t_msg**, int);
+void queue_served(t_queue*, t_msg*, long long);
+STATUS qset_create(t_qset*, int);
+void qset_delete(t_qset*);
+void qset_register(t_qset*, t_queue*);
+int qset_receive_batch(t_qset*, t_msg**, int, int);
+int qset_select(t_qset*, t_msg**, int);
+void qset_show(t_qset*);
+t_ring* ring_create(int, bool, bool);
+void ring_delete(t_ring*);
+STATUS ring_send(t_ring*, t_msg*);
+int ring_receive_batch(t_ring*, t_msg**, int);
+STATUS pool_create(t_pool*, int);
+void pool_delete(t_pool*);
+t_msg* msg_alloc(t_pool*);
+void msg_free(t_pool*, t_msg*);
+void msg_send(t_queue*);
+void deque_init(t_deque*);
+STATUS deque_push(t_deque*, t_msg*);
+t_msg* deque_pop(t_deque*);
+t_msg* deque_steal(t_deque*);
+t_msg* worker_steal(t_worker*);
+void worker_idle(int);
+void worker_wake(int);
+void worker_process(t_worker*, t_msg*, int);
+void worker_wait_turn(t_worker*, t_queue*, int);
+void worker_pass_turn(t_queue*, int);
+void worker_show(int);
+long long monotonic_ns(void);
+void hist_record(t_hist*, long long);
+long long hist_percentile(t_hist*, double);
+void latencyShow(void);
 
 
 /*************************************************************************/
@@ -67,14 +352,29 @@ typedef int bool;
 
 int main(void) {
     struct timespec mytime;
+    t_queue* queue;
     int    nseconds = 0;
     int    depth_q1 = 0;
     int    depth_q2 = 0;
+    int    sources = 0;
     int    period = 0;
     int    low_bound = 0;
     int    up_bound = 0;
     int    comp_time = 0;
     int    max_read_msg = 0;
+    int    transport = -1;
+    int    overflow = -1;
+    int    dist = -1;
+    int    seed = -1;
+    int    policy = -1;
+    int    quantum_q1 = 0;
+    int    quantum_q2 = 0;
+    int    worker_cnt = 0;
+    int    ordered = -1;
+    int    timeline = -1;
+    int    i;
+    char   name[20];
+    cpuset_t cpus;
 
     /* get the simulation time */ 
     printf("\n\n");
@@ -91,12 +391,33 @@ int main(void) {
     };
     printf("Depth of periodic queue set to %d entries.\n\n", depth_q1);
 
-    /* get the maximal queue entries for queue #2*/ 
+    /* get the number of aperiodic producers, one queue each */
+    while ((sources < 1) || (sources > MAX_SOURCES)) {
+        printf("Enter number of aperiodic producers [1-%d]: ", MAX_SOURCES);
+        scanf("%d", &sources);
+    };
+    printf("Number of aperiodic producers set to %d.\n\n", sources);
+
+    /* get the maximal queue entries for the aperiodic queues */
     while ((depth_q2 < 1) || (depth_q2 > MAX_DEPTH)) {
-        printf("Enter depth of aperiodic queue [1-%d]: ", MAX_DEPTH);
+        printf("Enter depth of each aperiodic queue [1-%d]: ", MAX_DEPTH);
         scanf("%d", &depth_q2);
     };
-    printf("Depth of aperiodic queue set to %d entries.\n\n", depth_q2);
+    printf("Depth of aperiodic queues set to %d entries.\n\n", depth_q2);
+
+    /* get the transport of the queues */
+    while ((transport < TRANSPORT_MSGQ) || (transport > TRANSPORT_MPSC)) {
+        printf("Enter queue transport [0 message queue, 1 SPSC ring, 2 MPSC ring]: ");
+        scanf("%d", &transport);
+    };
+    printf("Queue transport set to %d.\n\n", transport);
+
+    /* get what a send to a full queue does */
+    while ((overflow < OVERFLOW_DROP_NEWEST) || (overflow > OVERFLOW_SPILL)) {
+        printf("Enter overflow policy [0 drop newest, 1 drop oldest, 2 coalesce, 3 spill]: ");
+        scanf("%d", &overflow);
+    };
+    printf("Overflow policy set to %d.\n\n", overflow);
 
     /* get the period for the periodic producer */ 
     while ((period < 1) || (period > MAX_PERIOD)) {
@@ -119,13 +440,39 @@ int main(void) {
     };
     printf("Upper bound for aperiodic timer set to %ds. \n\n", up_bound);
 
+    /* get the inter-arrival distribution and its seed */
+    while ((dist < ARRIVAL_UNIFORM) || (dist > ARRIVAL_MMPP)) {
+        printf("Enter arrival distribution [0 uniform, 1 exponential, 2 bursty MMPP]: ");
+        scanf("%d", &dist);
+    };
+    printf("Arrival distribution set to %d.\n\n", dist);
+    while (seed < 0) {
+        printf("Enter random seed [0-%d]: ", 0x7fffffff);
+        scanf("%d", &seed);
+    };
+    printf("Random seed set to %d.\n\n", seed);
+
     /* get the consumer computation time */ 
     while ((comp_time < 1) || (comp_time > MAX_COMP_TIME)) {
-        printf("Enter consumer computation time [1-%d s]: ", MAX_COMP_TIME);
+        printf("Enter consumer computation time per message [1-%d s]: ", MAX_COMP_TIME);
         scanf("%d", &comp_time);
     };
     printf("Consumer computation time set to %ds. \n\n", comp_time);
 
+    /* get the number of consumer workers */
+    while ((worker_cnt < 1) || (worker_cnt > MAX_WORKERS)) {
+        printf("Enter number of consumer workers [1-%d]: ", MAX_WORKERS);
+        scanf("%d", &worker_cnt);
+    };
+    printf("Number of consumer workers set to %d.\n\n", worker_cnt);
+
+    /* get whether the messages of a source are processed in order */
+    while ((ordered < 0) || (ordered > 1)) {
+        printf("Enter per-source ordering [0 off, 1 on]: ");
+        scanf("%d", &ordered);
+    };
+    printf("Per-source ordering set to %d.\n\n", ordered);
+
     /* get the max number of msgs read per consumer loop */ 
     while ((max_read_msg < MIN_MSG) || (max_read_msg > MAX_MSG)) {
         printf("Enter max number of messages read per consumer loop [%d-%d]: ", MIN_MSG, MAX_MSG);
@@ -133,6 +480,34 @@ int main(void) {
     };
     printf("Max number of messages read per consumer loop set to %d. \n\n", max_read_msg);
 
+    /* get the policy of the consumer across its queues */
+    while ((policy < POLICY_DRR) || (policy > POLICY_EDF)) {
+        printf("Enter consumer policy [0 deficit round-robin, 1 strict priority, 2 EDF]: ");
+        scanf("%d", &policy);
+    };
+    printf("Consumer policy set to %d.\n\n", policy);
+
+    /* get the DRR quanta, the other policies derive their parameters:
+     * the periodic queue has the highest priority and each message is due
+     * one period after it was sent, an aperiodic one after up_bound */
+    if (policy == POLICY_DRR) {
+        while ((quantum_q1 < 1) || (quantum_q1 > MAX_QUANTUM)) {
+            printf("Enter quantum of periodic queue [1-%d msgs]: ", MAX_QUANTUM);
+            scanf("%d", &quantum_q1);
+        };
+        printf("Quantum of periodic queue set to %d.\n\n", quantum_q1);
+        while ((quantum_q2 < 1) || (quantum_q2 > MAX_QUANTUM)) {
+            printf("Enter quantum of each aperiodic queue [1-%d msgs]: ", MAX_QUANTUM);
+            scanf("%d", &quantum_q2);
+        };
+        printf("Quantum of aperiodic queues set to %d.\n\n", quantum_q2);
+    }
+
+    while ((timeline < 0) || (timeline > 1)) {
+        printf("Export the timeline to "TIMELINE" [0 no, 1 yes]: ");
+        scanf("%d", &timeline);
+    };
+
 
     /* set clock to start at 0 */
     mytime.tv_sec  = 0;
@@ -144,28 +519,112 @@ int main(void) {
         printf("Current time set to %d sec %d ns \n\n",
                 (int) mytime.tv_sec, (int)mytime.tv_nsec);
 
-    /* set time slice to 100 ms */	
-    kernelTimeSlice(TIMESLICE); 	
-     
-    /* spawn (create and start) task */
-    tidProdPeriodic = taskSpawn("tProdPeriodic", 100, 0, STACK_SIZE,
-        (FUNCPTR)prodPeriodic, period, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-
-    /* spawn (create and start) task */
-    tidProdAperiodic = taskSpawn("tProdAperiodic", 100, 0, STACK_SIZE,
-        (FUNCPTR)prodAperiodic, low_bound, up_bound, 0, 0, 0, 0, 0, 0, 0, 0);
-
-    /* spawn (create and start) task */
-    tidConsumer = taskSpawn("tConsumer", 100, 0, STACK_SIZE,
-        (FUNCPTR)consumer, comp_time, max_read_msg, 0, 0, 0, 0, 0, 0, 0, 0);
+    if (timeline && traceExport(TIMELINE, ev_spans) == ERROR)
+        printf("Error traceExport\n");
+    if (traceStart(ev_formats, EV_CNT, NULL, stdout) == ERROR)
+        printf("Error traceStart\n");
+
+    /* messages in the queues and in the hands of the consumer */
+    if (pool_create(&msgPool, depth_q1 + sources*depth_q2
+                + worker_cnt*MAX_MSG + (sources + 1)*(1
+                + ((overflow == OVERFLOW_SPILL) ? SPILL_DEPTH : 1))) == ERROR)
+        printf("Error pool_create\n");
+
+    /* the producers and the flush timers of the queues run on the timer
+     * wheel of tProducers */
+    if ((producers = wheelCreate("tProducers", 100, 0)) == NULL) {
+        printf("Error wheelCreate\n");
+        return(-1);
+    }
 
-    /* run for given simulation time */
-    taskDelay(nseconds*60);
+    /* create the queues before the producers and the consumer use them */
+    if (qset_create(&consumerSet, policy) == ERROR)
+        printf("Error qset_create\n");
+    queueCnt = sources + 1;
+    for (i = 0; i < queueCnt; i++) {
+        queue = &queues[i];
+        if (queue_create(queue, (i == 0) ? depth_q1 : depth_q2, transport,
+                    overflow) == ERROR) {
+            printf("Error queue_create\n");
+            continue;
+        }
+        queue->index = i;
+        queue->prio = i;
+        queue->ordered = ordered;
+        if (i == 0) {
+            strcpy(queue->name, STR_PERIODIC);
+            queue->type = TYPE_PERIODIC;
+            queue->quantum = quantum_q1;
+            queue->deadline = period * 1000000000LL;
+        }
+        else {
+            sprintf(queue->name, STR_APERIODIC"_%d", i);
+            queue->type = TYPE_APERIODIC;
+            queue->quantum = quantum_q2;
+            queue->deadline = up_bound * 1000000000LL;
+        }
+        qset_register(&consumerSet, queue);
+        printf("Queue %s created.\n", queue->name);
+        if (queue->ring != NULL && queue->ring->mask + 1 != (unsigned int)
+                ((i == 0) ? depth_q1 : depth_q2))
+            printf("Depth of queue %s rounded up to %u entries.\n", queue->name,
+                    queue->ring->mask + 1);
+    }
 
-    /* delete task */
-    taskDelete(tidProdPeriodic);
-    taskDelete(tidProdAperiodic);
-    taskDelete(tidConsumer);
+    /* set time slice to 100 ms */	
+    kernelTimeSlice(delayTicks(TIMESLICE));
+
+    /* start the producers */
+    prodPeriodic(period);
+    for (i = 0; i < sources; i++)
+        prodAperiodic(low_bound, up_bound, i+1, dist, seed);
+
+    /* create the workers, spread over the CPUs, and start them */
+    workerCnt = worker_cnt;
+    dispatchToken = 0;
+    idleWorkers = 0;
+    semIdle = semCCreate(SEM_Q_FIFO, 0);
+    for (i = 0; i < workerCnt; i++) {
+        workers[i].id = i;
+        deque_init(&workers[i].deque);
+        workers[i].turn = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+        sprintf(name, "tConsumer_%d", i);
+        tidConsumer[i] = taskCreate(name, 100, 0, STACK_SIZE,
+            (FUNCPTR)consumer, comp_time, max_read_msg, i, 0, 0, 0, 0, 0, 0, 0);
+        CPUSET_ZERO(cpus);
+        CPUSET_SET(cpus, i % vxCpuConfiguredGet());
+        if (taskCpuAffinitySet(tidConsumer[i], cpus) == ERROR)
+            printf("Warning: %s not bound to its CPU\n", name);
+    }
+    for (i = 0; i < workerCnt; i++)
+        taskActivate(tidConsumer[i]);
+
+    /* run for given simulation time, on the clock set to 0 above */
+    delayUntilRt(nseconds * 1000000000LL, NULL);
+
+    /* stop the producers, delete tasks */
+    wheelTimerCancel(&periodicTimer);
+    for (i = 0; i < sources; i++)
+        wheelTimerCancel(&arrivals[i].timer);
+    for (i = 0; i < workerCnt; i++)
+        taskDelete(tidConsumer[i]);
+    for (i = 0; i < queueCnt; i++)
+        wheelTimerCancel(&queues[i].flush);
+    traceStop();
+
+    qset_show(&consumerSet);
+    worker_show(nseconds);
+    latencyShow();
+    wheelShow(producers);
+    delayShow(&computeDelays);
+    wheelDelete(producers);
+    semDelete(semIdle);
+    for (i = 0; i < workerCnt; i++)
+        semDelete(workers[i].turn);
+    for (i = 0; i < queueCnt; i++)
+        queue_delete(&queues[i]);
+    qset_delete(&consumerSet);
+    pool_delete(&msgPool);
 
     printf("Exiting. \n\n");
     return(0);
@@ -173,234 +632,1093 @@ int main(void) {
 
 
 /*************************************************************************/
-/*  task "tProdPeriodic"                                                 */
+/*  periodic producer                                                    */
 /*                                                                       */
 /*************************************************************************/
 
 void prodPeriodic(int period) {
-	int i;
-	timer_t ptimer;
-	struct itimerspec intervaltimer;
-    int msgCnt = 0;
-        
-    /* create message queue */
-    if ((qidPeriodic = msgQCreate (MAX_DEPTH, MAX_MSG_LEN, MSG_Q_PRIORITY)) == NULL)
-		printf("Error msgQCreate\n");
-	else
-		printf("Queue for periodic producer created.\n");
-
-	/* create timer */
-	if ( timer_create(CLOCK_REALTIME, NULL, &ptimer) == ERROR)
-		printf("Error create_timer\n");
-	else
-		printf("Timer for periodic producer created.\n");
-
 	/* connect timer to timer handler routine */
-	if ( timer_connect(ptimer, (VOIDFUNCPTR)timerHandlerPeriodic, (int)&msgCnt) == ERROR )
-		printf("Error connect_timer\n");
-	else
-		printf("Timer handler for periodic producer connected.\n");
+	wheelTimerInit(&periodicTimer, producers, (VOIDFUNCPTR)timerHandlerPeriodic,
+            (_Vx_usr_arg_t)&queues[0]);
 
 	/* set and arm timer */
-	intervaltimer.it_value.tv_sec = period;
-	intervaltimer.it_value.tv_nsec = 0;
-	intervaltimer.it_interval.tv_sec = period;
-	intervaltimer.it_interval.tv_nsec = 0;
-
-	if ( timer_settime(ptimer, TIMER_ABSTIME, &intervaltimer, NULL) == ERROR )
+	if (wheelTimerStart(&periodicTimer, period * 1000000000LL,
+                period * 1000000000LL) == ERROR)
 		printf("Error set_timer\n");
 	else
-		printf("Timer for periodic producer set to %ds.\n\n",
-                intervaltimer.it_interval.tv_sec);
-
-	/* idle loop */
-	while(1) pause();
+		printf("Timer for periodic producer set to %ds.\n\n", period);
 }
 
 
 /*************************************************************************/
-/*  task "tProdAeriodic"                                                 */
+/*  aperiodic producers                                                  */
 /*                                                                       */
 /*************************************************************************/
 
-void prodAperiodic(int low_bound, int up_bound) {
-    int i;
-    int period;
-    timer_t ptimer;
-    struct  itimerspec intervaltimer;
-    int msgCnt = 0;
-
-    /* create message queue */
-    if ((qidAperiodic = msgQCreate (MAX_DEPTH, MAX_MSG_LEN, MSG_Q_PRIORITY)) == NULL)
-		printf("Error msgQCreate\n");
-	else
-		printf("Queue for aperiodic producer created.\n");
-
-    /* create timer */
-    if ( timer_create(CLOCK_REALTIME, NULL, &ptimer) == ERROR)
-        printf("Error create_timer\n");
-    else
-        printf("Timer for aperiodic producer created.\n");
+/* every arrival arms the timer once more for the next one, a fresh
+ * inter-arrival time drawn from the distribution */
+void prodAperiodic(int low_bound, int up_bound, int source, int dist, int seed) {
+    t_arrival* arrival = &arrivals[source - 1];
+    unsigned long long mix = (unsigned long long)seed << 8 | source;
+
+    /* one generator per producer, seeded apart from the others */
+    arrival->queue = &queues[source];
+    arrival->dist = dist;
+    arrival->low = low_bound * 1000000000LL;
+    arrival->up = up_bound * 1000000000LL;
+    arrival->next = 0;
+    arrival->burst = false;
+    arrival->dwell = 0;
+    do
+        arrival->rng = splitmix64(&mix);
+    while (arrival->rng == 0);
 
     /* connect timer to timer handler routine */
-    if ( timer_connect(ptimer, (VOIDFUNCPTR)timerHandlerAperiodic, (int)&msgCnt) == ERROR )
-        printf("Error connect_timer\n");
+    wheelTimerInit(&arrival->timer, producers, (VOIDFUNCPTR)timerHandlerAperiodic,
+            (_Vx_usr_arg_t)arrival);
+
+    /* arm timer for the first arrival */
+    if (arrival_arm(arrival) == ERROR)
+        printf("Error set_timer\n");
     else
-        printf("Timer handler for aperiodic producer connected.\n");
+        printf("Timer for aperiodic producer %d set to %.3fs.\n\n", source,
+                arrival->next / 1e9);
+}
 
-    /* generate random period */
-    period = random_in_range(low_bound, up_bound+1);
 
-    /* set and arm timer */
-    intervaltimer.it_value.tv_sec = period;
-    intervaltimer.it_value.tv_nsec = 0;
-    intervaltimer.it_interval.tv_sec = period;
-    intervaltimer.it_interval.tv_nsec = 0;
+/*************************************************************************/
+/*  task "tConsumer"                                                     */
+/*                                                                       */
+/*************************************************************************/
 
-    if ( timer_settime(ptimer, TIMER_ABSTIME, &intervaltimer, NULL) == ERROR )
-        printf("Error set_timer\n");
-    else
-        printf("Timer for aperiodic producer set to %ds.\n\n",
-                intervaltimer.it_interval.tv_sec);
+/* a worker runs the messages in its deque oldest first and steals the
+ * newest one of another worker when it runs dry. If there is nothing to
+ * steal it takes the dispatch token, if free, and receives the next batch
+ * from the queue set into its own deque; otherwise it sleeps until a
+ * batch or the token is handed out */
+void consumer(int comp_time, int max_read_msg, int id) {
+    t_worker* self = &workers[id];
+    t_msg* msgs[MAX_MSG];
+    t_msg* msg;
+    t_queue* queue;
+    int i, n;
+
+    while (1) {
+        if ((msg = deque_pop(&self->deque)) == NULL)
+            msg = worker_steal(self);
+
+        if (msg == NULL
+                && __atomic_exchange_n(&dispatchToken, 1, __ATOMIC_ACQUIRE) == 0) {
+            n = qset_receive_batch(&consumerSet, msgs, max_read_msg,
+                    delayTicks(comp_time * 1000000000LL));
+            for (i = 0; i < n; i++) {
+                queue = &queues[msgs[i]->source];
+                if (queue->ordered)
+                    msgs[i]->ticket = queue->ticket++;
+            }
+            __atomic_store_n(&dispatchToken, 0, __ATOMIC_SEQ_CST);
+
+            /* keep the first one, the others go bottom up so that the
+             * oldest is popped next and the newest is stolen first */
+            for (i = n - 1; i > 0; i--)
+                deque_push(&self->deque, msgs[i]);
+            worker_wake(n);
+            if (n == 0)
+                continue; // timed out, all queues are empty
+            msg = msgs[0];
+        }
 
-    /* idle loop */
-    while(1) pause();
+        if (msg == NULL)
+            worker_idle(delayTicks(comp_time * 1000000000LL));
+        else
+            worker_process(self, msg, comp_time);
+    };
 }
 
 
 /*************************************************************************/
-/*  task "tConsumer"                                                     */
+/*  function "TimerHandlerPeriodic"                                      */
 /*                                                                       */
 /*************************************************************************/
 
-void consumer(int comp_time, int max_read_msg) {
-    char msgBuf[MAX_MSG_LEN];
-    int byteCnt, i, zeroCnt;
-    MSG_Q_ID qid;
-    bool periodic = true;
+void timerHandlerPeriodic(WHEEL_TIMER* timer, t_queue* queue) {
+    (void)timer;
+    msg_send(queue);
+}
+
+
+/*************************************************************************/
+/*  function "TimerHandlerAperiodic"                                     */
+/*                                                                       */
+/*************************************************************************/
+
+void timerHandlerAperiodic(WHEEL_TIMER* timer, t_arrival* arrival) {
+    (void)timer;
+    msg_send(arrival->queue);
+    if (arrival_arm(arrival) == ERROR)
+        printf("Error set_timer\n");
+}
+
+
+/*************************************************************************/
+/*  function "msg_send"                                                  */
+/*                                                                       */
+/*  fill a pooled message in place and pass it on by handle              */
+/*                                                                       */
+/*************************************************************************/
+
+void msg_send(t_queue* queue) {
     struct timespec mytime;
-    char* src;
+    t_msg* msg;
+    int cnt = queue->seq++;
 
-    while (1) {
-        taskDelay(comp_time*60);
-        qid = (periodic) ? qidPeriodic : qidAperiodic;
-        zeroCnt = 0;
-        for (i=0; i<max_read_msg; i++) {
-            /* get message from queue */
-            if (msgQReceive(qid, msgBuf, MAX_MSG_LEN, NO_WAIT) == ERROR) {
-                if (errno == S_objLib_OBJ_UNAVAILABLE) {
-                    // printf("Queue empty\n");
-                    zeroCnt++;
-                    if (zeroCnt >= 2)
-                        break; // both queues are empty
-
-                    // one queue is empty, switch to the other
-                    qid = (periodic) ? qidAperiodic : qidPeriodic;
+    if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR) 
+        printf("Error: clock_gettime \n");
+
+    if ((msg = msg_alloc(&msgPool)) == NULL) {
+        printf("Error: message pool exhausted\n");
+        return;
+    }
+    msg->type = queue->type;
+    msg->source = queue->index;
+    msg->seq = cnt;
+    msg->stamp = monotonic_ns();
+    msg->deadline = msg->stamp + queue->deadline;
+    msg->coalesced = 0;
+    msg->len = 0;
+    if (queue_send(queue, msg) == ERROR) {
+        msg_free(&msgPool, msg);
+        TRACE(TRACE_WARNING, EV_DROPPED, queue->name, cnt, mytime.tv_sec);
+        return;
+    }
+
+    TRACE(TRACE_INFO, EV_SENT, queue->name, cnt, mytime.tv_sec);
+}
+
+/*************************************************************************/
+/*  arrival process                                                      */
+/*                                                                       */
+/*  the arrivals are scheduled on absolute time, so the latency of the   */
+/*  timer handler does not shift the ones that follow                    */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS arrival_arm(t_arrival* arrival) {
+    arrival->next += arrival_next(arrival);
+    return wheelTimerStart(&arrival->timer, arrival->next, 0);
+}
+
+/* time to the next arrival, ns. The MMPP switches state when its stay,
+ * itself exponential, runs out before the next arrival; as both are
+ * memoryless the arrival is drawn anew in the other state from there */
+long long arrival_next(t_arrival* arrival) {
+    double mean, gap = 0;
+    double u;
+
+    switch (arrival->dist) {
+        case ARRIVAL_EXPONENTIAL:
+            gap = rng_exponential(&arrival->rng, (arrival->low + arrival->up) / 2.0);
+            break;
+
+        case ARRIVAL_MMPP:
+            while (1) {
+                mean = (arrival->burst) ? arrival->low : arrival->up;
+                if (arrival->dwell <= 0)
+                    arrival->dwell = rng_exponential(&arrival->rng, mean * MMPP_DWELL);
+                u = rng_exponential(&arrival->rng, mean);
+                if (u < arrival->dwell) {
+                    arrival->dwell -= u;
+                    gap += u;
+                    break;
+                }
+                gap += arrival->dwell;
+                arrival->dwell = 0;
+                arrival->burst = !arrival->burst;
+            }
+            break;
+
+        default:
+            gap = arrival->low + rng_uniform(&arrival->rng) * (arrival->up - arrival->low);
+            break;
+    }
+    return (gap < 1) ? 1 : (long long)gap;
+}
+
+
+/*************************************************************************/
+/*  random numbers                                                       */
+/*                                                                       */
+/*  xorshift64* (Vigna): a few shifts and one multiply, state per        */
+/*  generator, so producers neither share nor lock one. splitmix64       */
+/*  spreads a seed into well-mixed, distinct states                      */
+/*                                                                       */
+/*************************************************************************/
+
+unsigned long long splitmix64(unsigned long long* x) {
+    unsigned long long z = (*x += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+unsigned long long rng_next(unsigned long long* state) {
+    unsigned long long x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* in [0, 1), 53 bits */
+double rng_uniform(unsigned long long* state) {
+    return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double rng_exponential(unsigned long long* state, double mean) {
+    return -mean * log(1.0 - rng_uniform(state));
+}
+
+
+/*************************************************************************/
+/*  producer-consumer queues                                             */
+/*                                                                       */
+/*  the queues carry message handles. Sending never blocks, neither on   */
+/*  the kernel message queue nor on the rings                            */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS queue_create(t_queue* queue, int depth, int transport, int overflow) {
+    bool shared = (overflow == OVERFLOW_DROP_OLDEST);
+
+    memset(queue, 0, sizeof(t_queue));
+    queue->transport = transport;
+    queue->overflow = overflow;
+    queue->quantum = 1;
+    if (overflow == OVERFLOW_SPILL
+            && (queue->spill = calloc(SPILL_DEPTH, sizeof(t_msg*))) == NULL)
+        return ERROR;
+    if (overflow == OVERFLOW_SPILL || overflow == OVERFLOW_COALESCE)
+        wheelTimerInit(&queue->flush, producers, (VOIDFUNCPTR)queue_flush_timer,
+                (_Vx_usr_arg_t)queue);
+    if (transport == TRANSPORT_MSGQ)
+        queue->qid = msgQCreate(depth, sizeof(t_msg*), MSG_Q_PRIORITY);
+    else
+        queue->ring = ring_create(depth, transport == TRANSPORT_MPSC || shared,
+                shared);
+    return (queue->qid == NULL && queue->ring == NULL) ? ERROR : OK;
+}
+
+void queue_delete(t_queue* queue) {
+    if (queue->qid != NULL)
+        msgQDelete(queue->qid);
+    if (queue->ring != NULL)
+        ring_delete(queue->ring);
+    free(queue->spill);
+}
+
+/* send without blocking, a full queue is handled by its overflow policy.
+ * Messages held back go into the queue ahead of the next one, so that
+ * the queue keeps the order they were sent in. ERROR if the message was
+ * dropped */
+STATUS queue_send(t_queue* queue, t_msg* msg) {
+    STATUS status = OK;
+
+    queue_flush(queue);
+
+    if (queue->spill_cnt > 0 || queue->pending != NULL
+            || queue_put(queue, msg) == ERROR) {
+        switch (queue->overflow) {
+            case OVERFLOW_DROP_OLDEST:
+                if (queue_evict(queue) == OK)
+                    queue->dropped++;
+                if (queue_put(queue, msg) == ERROR) {
+                    queue->dropped++;
+                    status = ERROR;
                 }
-                else {
-                    printf("Error msgQReceive\n");
+                break;
+
+            case OVERFLOW_COALESCE:
+                if (queue->pending != NULL) {
+                    msg->coalesced = queue->pending->coalesced + 1;
+                    msg_free(&msgPool, queue->pending);
+                    queue->coalesced++;
+                }
+                queue->pending = msg;
+                break;
+
+            case OVERFLOW_SPILL:
+                if (queue->spill_cnt == SPILL_DEPTH) {
+                    queue->dropped++;
+                    status = ERROR;
+                    break;
                 }
+                queue->spill[(queue->spill_head + queue->spill_cnt) % SPILL_DEPTH] = msg;
+                if (++queue->spill_cnt > queue->spill_max)
+                    queue->spill_max = queue->spill_cnt;
+                break;
+
+            default:
+                queue->dropped++;
+                status = ERROR;
+                break;
+        }
+    }
+
+    /* announce the held back messages before the last try, the consumer
+     * looks for them after it made room, so one of the two sees the other */
+    if (queue->spill_cnt > 0 || queue->pending != NULL) {
+        __atomic_store_n(&queue->held, 1, __ATOMIC_SEQ_CST);
+        queue_flush(queue);
+    }
+    queue_wake(queue);
+    return status;
+}
+
+/* put the held back messages into the queue as far as it has room, on the
+ * producer side */
+void queue_flush(t_queue* queue) {
+    while (queue->spill_cnt > 0
+            && queue_put(queue, queue->spill[queue->spill_head]) == OK) {
+        queue->spill_head = (queue->spill_head + 1) % SPILL_DEPTH;
+        queue->spill_cnt--;
+    }
+    if (queue->pending != NULL && queue_put(queue, queue->pending) == OK)
+        queue->pending = NULL;
+    if (queue->spill_cnt == 0 && queue->pending == NULL)
+        __atomic_store_n(&queue->held, 0, __ATOMIC_RELAXED);
+}
+
+/* runs in tProducers like the producers, so the messages held back are
+ * only ever touched by that task */
+void queue_flush_timer(WHEEL_TIMER* timer, t_queue* queue) {
+    (void)timer;
+    queue_flush(queue);
+    queue_wake(queue);
+}
+
+/* publish a message and count it, ERROR if the queue is full */
+STATUS queue_put(t_queue* queue, t_msg* msg) {
+    STATUS status;
+    int backlog;
+
+    if (queue->transport == TRANSPORT_MSGQ) {
+        /* send a normal priority message */
+        status = msgQSend(queue->qid, (char*)&msg, sizeof(msg), NO_WAIT,
+                MSG_PRI_NORMAL);
+    }
+    else {
+        status = ring_send(queue->ring, msg);
+    }
+    if (status == ERROR)
+        return status;
+
+    backlog = __atomic_add_fetch(&queue->backlog, 1, __ATOMIC_RELEASE);
+    if (backlog > queue->backlog_max)
+        queue->backlog_max = backlog;
+    return OK;
+}
+
+/* take the oldest message out of the queue and drop it; the kernel queue
+ * and a shared ring may be received from by the producer too */
+STATUS queue_evict(t_queue* queue) {
+    t_msg* msg;
+
+    if (queue->transport == TRANSPORT_MSGQ) {
+        if (msgQReceive(queue->qid, (char*)&msg, sizeof(t_msg*), NO_WAIT) == ERROR)
+            return ERROR;
+    }
+    else if (ring_receive_batch(queue->ring, &msg, 1) == 0) {
+        return ERROR;
+    }
+    __atomic_sub_fetch(&queue->backlog, 1, __ATOMIC_RELAXED);
+    msg_free(&msgPool, msg);
+    return OK;
+}
+
+/* wake the consumer if it sleeps; the fence orders the messages counted
+ * before the check of its waiting flag, so that the common case costs
+ * one load and no system call */
+void queue_wake(t_queue* queue) {
+    t_wakeup* wakeup = queue->wakeup;
+
+    if (wakeup != NULL) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&wakeup->waiting, __ATOMIC_RELAXED)
+                && __atomic_exchange_n(&wakeup->waiting, 0, __ATOMIC_ACQ_REL))
+            semGive(wakeup->sem);
+    }
+}
+
+/* take up to max messages without blocking */
+int queue_drain(t_queue* queue, t_msg** msgs, int max) {
+    int n;
+
+    if (queue->transport != TRANSPORT_MSGQ)
+        return ring_receive_batch(queue->ring, msgs, max);
+    for (n = 0; n < max; n++) {
+        if (msgQReceive(queue->qid, (char*)&msgs[n], sizeof(t_msg*), NO_WAIT) == ERROR)
+            break;
+    }
+    return n;
+}
+
+/* drain a queue that has a backlog and count the messages taken. A
+ * message can be taken before its send is counted, so the backlog may
+ * drop below 0 for a moment */
+int queue_take(t_queue* queue, t_msg** msgs, int max) {
+    int n;
+
+    if (__atomic_load_n(&queue->backlog, __ATOMIC_ACQUIRE) <= 0)
+        return 0;
+    n = queue_drain(queue, msgs, max);
+    if (n > 0)
+        __atomic_sub_fetch(&queue->backlog, n, __ATOMIC_RELAXED);
+
+    /* room was made, let the producer side put in what it held back */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (n > 0 && __atomic_load_n(&queue->held, __ATOMIC_RELAXED))
+        wheelTimerStart(&queue->flush, delayNowRt(), 0);
+    return n;
+}
+
+/* account a message handed to the consumer at now (CLOCK_MONOTONIC ns) */
+void queue_served(t_queue* queue, t_msg* msg, long long now) {
+    long long wait = now - msg->stamp;
+
+    queue->served++;
+    queue->batch_served++;
+    queue->wait_sum += wait;
+    if (wait > queue->wait_max)
+        queue->wait_max = wait;
+}
+
+
+/*************************************************************************/
+/*  queue set                                                            */
+/*                                                                       */
+/*  the queues of one consumer. It receives in batches, picks the        */
+/*  messages of a batch by the policy of the set and only blocks when    */
+/*  all of its queues are empty                                          */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS qset_create(t_qset* set, int policy) {
+    memset(set, 0, sizeof(t_qset));
+    set->policy = policy;
+    set->wakeup.sem = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+    return (set->wakeup.sem == NULL) ? ERROR : OK;
+}
+
+void qset_delete(t_qset* set) {
+    int i;
+
+    /* messages taken ahead go back to the pool */
+    for (i = 0; i < set->cnt; i++) {
+        if (set->queue[i]->head != NULL)
+            msg_free(&msgPool, set->queue[i]->head);
+        set->queue[i]->head = NULL;
+    }
+    semDelete(set->wakeup.sem);
+}
+
+/* register a queue before its producer starts; the set is kept sorted by
+ * priority, ties in order of registration */
+void qset_register(t_qset* set, t_queue* queue) {
+    int i;
+
+    if (set->cnt == MAX_QUEUES) {
+        printf("Error: too many queues\n");
+        return;
+    }
+    queue->wakeup = &set->wakeup;
+    for (i = set->cnt; i > 0 && set->queue[i-1]->prio > queue->prio; i--)
+        set->queue[i] = set->queue[i-1];
+    set->queue[i] = queue;
+    set->cnt++;
+}
+
+/* receive up to max messages in one call. If all queues are empty, block
+ * until the first message arrives or the timeout (in ticks) expires;
+ * returns the number received, 0 on timeout. A wakeup left over from an
+ * earlier call may also return 0 early */
+int qset_receive_batch(t_qset* set, t_msg** msgs, int max, int timeout) {
+    t_wakeup* wakeup = &set->wakeup;
+    int n;
+
+    n = qset_select(set, msgs, max);
+    if (n > 0 || timeout == NO_WAIT)
+        return n;
+
+    /* announce the sleep, then look once more: a message counted before
+     * the announcement is seen here, one counted after it wakes us */
+    __atomic_store_n(&wakeup->waiting, 1, __ATOMIC_SEQ_CST);
+    n = qset_select(set, msgs, max);
+    if (n == 0)
+        semTake(wakeup->sem, timeout);
+    __atomic_store_n(&wakeup->waiting, 0, __ATOMIC_RELAXED);
+
+    if (n == 0)
+        n = qset_select(set, msgs, max);
+    return n;
+}
+
+/* pick up to max messages without blocking. Queues without a backlog are
+ * skipped on one load of their counter. Round-robin serves each queue up
+ * to its quantum per round and carries the rest of a round that did not
+ * fit into the batch over to the next one; an emptied queue loses its
+ * credit. EDF keeps the oldest message of each queue in hand and passes
+ * on the one due first */
+int qset_select(t_qset* set, t_msg** msgs, int max) {
+    long long now = monotonic_ns();
+    t_queue* queue;
+    t_queue* first;
+    int i, n = 0, got, want, idle;
+
+    switch (set->policy) {
+        case POLICY_DRR:
+            for (idle = 0; n < max && idle < set->cnt; ) {
+                queue = set->queue[set->next];
+                if (queue->deficit == 0)
+                    queue->deficit = queue->quantum;
+                want = (queue->deficit < max - n) ? queue->deficit : max - n;
+                got = queue_take(queue, msgs + n, want);
+                for (i = n; i < n + got; i++)
+                    queue_served(queue, msgs[i], now);
+                n += got;
+                queue->deficit -= got;
+                if (got < want)
+                    queue->deficit = 0;
+                if (queue->deficit == 0)
+                    set->next = (set->next + 1) % set->cnt;
+                idle = (got == 0) ? idle + 1 : 0;
             }
-            else {
-                if (msgBuf[0] == TYPE_PERIODIC)
-                    src = STR_PERIODIC;
-                else if (msgBuf[0] == TYPE_APERIODIC)
-                    src = STR_APERIODIC;
-                else
-                    printf("Error: unknown source\n");
-
-                if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR) 
-                    printf("Error: clock_gettime \n");
-
-                printf(IDENT"CONSUMER: message #%03s from %s @ %03ds.\n",
-                        msgBuf+1, src, (int)mytime.tv_sec);
+            break;
+
+        case POLICY_PRIORITY:
+            for (i = 0; i < set->cnt && n < max; i++) {
+                got = queue_take(set->queue[i], msgs + n, max - n);
+                while (got-- > 0)
+                    queue_served(set->queue[i], msgs[n++], now);
             }
+            break;
+
+        case POLICY_EDF:
+            while (n < max) {
+                first = NULL;
+                for (i = 0; i < set->cnt; i++) {
+                    queue = set->queue[i];
+                    if (queue->head == NULL
+                            && queue_take(queue, &queue->head, 1) == 0)
+                        continue;
+                    if (first == NULL || queue->head->deadline < first->head->deadline)
+                        first = queue;
+                }
+                if (first == NULL)
+                    break;
+                queue_served(first, first->head, now);
+                msgs[n++] = first->head;
+                first->head = NULL;
+            }
+            break;
+    }
+
+    /* queues with messages left that got nothing in this batch */
+    if (n > 0) {
+        for (i = 0; i < set->cnt; i++) {
+            queue = set->queue[i];
+            if (queue->batch_served == 0 && (queue->head != NULL
+                        || __atomic_load_n(&queue->backlog, __ATOMIC_RELAXED) > 0))
+                queue->skipped++;
+            queue->batch_served = 0;
         }
-        periodic = (periodic) ? false : true; //periodic = !periodic;
-    };
+    }
+    return n;
+}
+
+/* backlog, overflow and starvation of the queues */
+void qset_show(t_qset* set) {
+    t_queue* queue;
+    int i;
+
+    printf("\n%-14s %4s %7s %7s %7s %7s %7s %7s %7s %7s %10s %10s\n", "QUEUE",
+            "PRIO", "SENT", "SERVED", "BACKLOG", "MAX", "SPILL", "DROPPED",
+            "MERGED", "SKIPPED", "AVG WAIT", "MAX WAIT");
+    for (i = 0; i < set->cnt; i++) {
+        queue = set->queue[i];
+        printf("%-14s %4d %7d %7lld %7d %7d %7d %7d %7d %7lld %8.3fs %8.3fs\n",
+                queue->name, queue->prio, queue->seq, queue->served,
+                queue->backlog + (queue->head != NULL), queue->backlog_max,
+                queue->spill_max, queue->dropped, queue->coalesced,
+                queue->skipped,
+                (queue->served > 0) ? queue->wait_sum / 1e9 / queue->served : 0.0,
+                queue->wait_max / 1e9);
+    }
+    printf("\n");
 }
 
 
+
 /*************************************************************************/
-/*  function "TimerHandlerPeriodic"                                      */
+/*  consumer workers                                                     */
+/*                                                                       */
+/*  messages of an ordered queue carry a ticket drawn at dispatch; a     */
+/*  worker waits for its turn before processing one, so a source is      */
+/*  processed in order while the others run in parallel. The worker      */
+/*  done with a ticket hands the turn to the one waiting for the next    */
 /*                                                                       */
 /*************************************************************************/
 
-void timerHandlerPeriodic(timer_t callingtimer, int* msgCnt) {
+/* try the other workers once, starting with the next one */
+t_msg* worker_steal(t_worker* self) {
+    t_msg* msg;
+    int i;
+
+    for (i = 1; i < workerCnt; i++) {
+        msg = deque_steal(&workers[(self->id + i) % workerCnt].deque);
+        if (msg != NULL) {
+            self->stolen++;
+            return msg;
+        }
+    }
+    return NULL;
+}
+
+/* sleep until woken or the timeout (in ticks) expires. The count of idle
+ * workers is raised before the last look for work, and a dispatcher reads
+ * it after handing out work, so one of the two sees the other */
+void worker_idle(int timeout) {
+    int i;
+    bool pending = false;
+
+    __atomic_add_fetch(&idleWorkers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dispatchToken, __ATOMIC_SEQ_CST) == 0)
+        pending = true;
+    for (i = 0; i < workerCnt && !pending; i++) {
+        if (__atomic_load_n(&workers[i].deque.bottom, __ATOMIC_SEQ_CST)
+                > __atomic_load_n(&workers[i].deque.top, __ATOMIC_SEQ_CST))
+            pending = true;
+    }
+    if (!pending)
+        semTake(semIdle, timeout);
+    __atomic_sub_fetch(&idleWorkers, 1, __ATOMIC_RELAXED);
+}
+
+/* wake at most cnt idle workers */
+void worker_wake(int cnt) {
+    int idle;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    idle = __atomic_load_n(&idleWorkers, __ATOMIC_RELAXED);
+    for (; cnt > 0 && idle > 0; cnt--, idle--)
+        semGive(semIdle);
+}
+
+void worker_process(t_worker* self, t_msg* msg, int comp_time) {
     struct timespec mytime;
-    char msgId[MAX_MSG_LEN-1];
-    char msg[MAX_MSG_LEN];
-    // printf("periodic: set msgId\n");
-    sprintf(msgId, "%d", *msgCnt);
-    // printf("periodic: set msg\n");
-    sprintf(msg, "%c%d", TYPE_PERIODIC, *msgCnt);
-    (*msgCnt)++;
-
-    // printf("periodic: set time\n");
-    if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR) 
+    t_queue* queue = &queues[msg->source];
+    long long latency;
+
+    if (queue->ordered)
+        worker_wait_turn(self, queue, msg->ticket);
+
+    latency = monotonic_ns() - msg->stamp;
+    hist_record(&queue->latency, latency);
+
+    if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR)
         printf("Error: clock_gettime \n");
+    if (msg->coalesced > 0)
+        TRACE(TRACE_INFO, EV_COALESCED, self->id, msg->seq, msg->coalesced,
+                queue->name, mytime.tv_sec, latency / 1000);
+    else
+        TRACE(TRACE_INFO, EV_PROCESSED, self->id, msg->seq, queue->name,
+                mytime.tv_sec, latency / 1000);
+    delayNs(comp_time * 1000000000LL, &computeDelays);
+    TRACE(TRACE_INFO, EV_DONE, 0);
+
+    if (queue->ordered)
+        worker_pass_turn(queue, msg->ticket + 1);
+    msg_free(&msgPool, msg);
+    self->processed++;
+}
 
-    // printf("periodic: send msg\n");
-    /* send a normal priority message, blocking if queue is full */
-    if (msgQSend (qidPeriodic, msg, sizeof(msg), WAIT_FOREVER,
-                MSG_PRI_NORMAL) == ERROR)
-        printf("Error: msgQSend\n");
+/* sleep until ticket is the next of queue. The waiter announces itself
+ * before it looks at the turn, and the worker passing it on looks for a
+ * waiter after moving the turn, so one of the two sees the other; a give
+ * left over from an earlier wait only costs another look */
+void worker_wait_turn(t_worker* self, t_queue* queue, int ticket) {
+    self->wait_ticket = ticket;
+    __atomic_store_n(&self->wait_queue, queue, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&queue->done, __ATOMIC_SEQ_CST) != ticket)
+        semTake(self->turn, WAIT_FOREVER);
+    __atomic_store_n(&self->wait_queue, NULL, __ATOMIC_RELAXED);
+}
+
+/* move the turn of queue on to ticket and wake the worker holding it */
+void worker_pass_turn(t_queue* queue, int ticket) {
+    t_worker* worker;
+    int i;
 
-    printf(STR_PERIODIC":  message #%03s @ %03ds.\n", msgId, (int)mytime.tv_sec);
+    __atomic_store_n(&queue->done, ticket, __ATOMIC_SEQ_CST);
+    for (i = 0; i < workerCnt; i++) {
+        worker = &workers[i];
+        if (__atomic_load_n(&worker->wait_queue, __ATOMIC_SEQ_CST) == queue
+                && worker->wait_ticket == ticket) {
+            semGive(worker->turn);
+            break;
+        }
+    }
+}
+
+/* messages processed per worker over nseconds */
+void worker_show(int nseconds) {
+    long long total = 0;
+    int i;
+
+    printf("%-14s %9s %9s\n", "WORKER", "PROCESSED", "STOLEN");
+    for (i = 0; i < workerCnt; i++) {
+        printf("tConsumer_%-4d %9lld %9lld\n", i, workers[i].processed,
+                workers[i].stolen);
+        total += workers[i].processed;
+    }
+    printf("%lld messages, %.3f msgs/s\n\n", total, (double)total / nseconds);
 }
 
 
 /*************************************************************************/
-/*  function "TimerHandlerAperiodic"                                     */
+/*  latency histogram                                                    */
 /*                                                                       */
 /*************************************************************************/
 
-void timerHandlerAperiodic(timer_t callingtimer, int* msgCnt) {
+long long monotonic_ns(void) {
     struct timespec mytime;
-    char msgId[MAX_MSG_LEN-1];
-    char msg[MAX_MSG_LEN];
-    // printf("aperiodic: set msgId\n");
-    sprintf(msgId, "%d", *msgCnt);
-    // printf("aperiodic: set msg\n");
-    sprintf(msg, "%c%d", TYPE_APERIODIC, *msgCnt);
-    (*msgCnt)++;
-
-    // printf("aperiodic: set time\n");
-    if ( clock_gettime (CLOCK_REALTIME, &mytime) == ERROR) 
+
+    if ( clock_gettime (CLOCK_MONOTONIC, &mytime) == ERROR)
         printf("Error: clock_gettime \n");
+    return (long long)mytime.tv_sec * 1000000000LL + mytime.tv_nsec;
+}
+
+void hist_record(t_hist* hist, long long value) {
+    long long max;
+    int msb, shift, idx;
+
+    if (value < 0)
+        value = 0;
+    if (value < HIST_SUB) {
+        idx = (int)value;
+    }
+    else {
+        msb = 63 - __builtin_clzll(value);
+        shift = msb - HIST_SUB_BITS;
+        idx = (shift + 1) * HIST_SUB + (int)((value >> shift) - HIST_SUB);
+        if (idx >= HIST_BUCKETS)
+            idx = HIST_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&hist->cnt[idx], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&hist->max, &max, value,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/* the highest value of the bucket that holds the given fraction of the
+ * values, at most the maximum; a snapshot, recording may go on meanwhile */
+long long hist_percentile(t_hist* hist, double fraction) {
+    long long total = __atomic_load_n(&hist->total, __ATOMIC_RELAXED);
+    long long rank = (long long)ceil(fraction * total);
+    long long seen = 0;
+    long long value, max;
+    int idx, shift;
+
+    if (total == 0)
+        return 0;
+    if (rank < 1)
+        rank = 1;
+    for (idx = 0; idx < HIST_BUCKETS - 1; idx++) {
+        seen += __atomic_load_n(&hist->cnt[idx], __ATOMIC_RELAXED);
+        if (seen >= rank)
+            break;
+    }
+    if (idx < HIST_SUB)
+        return idx;
+    shift = idx / HIST_SUB - 1;
+    value = ((long long)(HIST_SUB + idx % HIST_SUB + 1) << shift) - 1;
+    max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    return (value > max) ? max : value;
+}
+
+/* latency percentiles per source; may be called at any time */
+void latencyShow(void) {
+    t_hist* hist;
+    int i;
+
+    printf("%-14s %9s %10s %10s %10s %10s\n", "LATENCY", "MSGS", "P50",
+            "P99", "P99.9", "MAX");
+    for (i = 0; i < queueCnt; i++) {
+        hist = &queues[i].latency;
+        printf("%-14s %9lld %8.3fms %8.3fms %8.3fms %8.3fms\n", queues[i].name,
+                hist->total, hist_percentile(hist, 0.5) / 1e6,
+                hist_percentile(hist, 0.99) / 1e6,
+                hist_percentile(hist, 0.999) / 1e6, hist->max / 1e6);
+    }
+    printf("\n");
+}
+
+
+/*************************************************************************/
+/*  work-stealing deque                                                  */
+/*                                                                       */
+/*  indices run freely, bottom - top messages are in the deque. The      */
+/*  owner never holds more than one batch, so it does not grow           */
+/*                                                                       */
+/*************************************************************************/
 
-    // printf("aperiodic: send msg\n");
-    /* send a normal priority message, blocking if queue is full */
-    if (msgQSend (qidAperiodic, msg, sizeof(msg), WAIT_FOREVER,
-                MSG_PRI_NORMAL) == ERROR)
-        printf("Error: msgQSend\n");
+void deque_init(t_deque* deque) {
+    deque->top = 0;
+    deque->bottom = 0;
+}
 
-    printf(STR_APERIODIC": message #%03s @ %03ds.\n", msgId, (int)mytime.tv_sec);
+STATUS deque_push(t_deque* deque, t_msg* msg) {
+    long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if (bottom - top >= DEQUE_SIZE)
+        return ERROR;
+    __atomic_store_n(&deque->buf[bottom & (DEQUE_SIZE - 1)], msg, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return OK;
 }
-  
+
+/* owner only; NULL when empty */
+t_msg* deque_pop(t_deque* deque) {
+    long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    long long top;
+    t_msg* msg;
+
+    /* claim the bottom first, then see whether a thief got there too */
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    msg = __atomic_load_n(&deque->buf[bottom & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        /* the last one, race the thieves for it */
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            msg = NULL;
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return msg;
+}
+
+/* any worker; NULL when empty or when another one won the race */
+t_msg* deque_steal(t_deque* deque) {
+    long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    long long bottom;
+    t_msg* msg;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return NULL;
+    msg = __atomic_load_n(&deque->buf[top & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return msg;
+}
+
+
 /*************************************************************************/
-/*  function "random_in_range"                                           */
+/*  lock-free ring buffer                                                */
 /*                                                                       */
-/*  proposed by Ryan Reich on http://stackoverflow.com                   */
+/*  indices run freely and are masked on access, so head == tail means  */
+/*  empty and tail - head == size means full                            */
 /*                                                                       */
 /*************************************************************************/
 
-/* Would like a semi-open interval [min, max) */
-int random_in_range (unsigned int min, unsigned int max)
-{
-    int base_random = rand(); /* in [0, RAND_MAX] */
-	/* now guaranteed to be in [0, RAND_MAX) */
-	int range = max - min;
-	int remainder = RAND_MAX % range;
-	int bucket    = RAND_MAX / range;
-    if (RAND_MAX == base_random) return random_in_range(min, max);
-  
-    /* There are range buckets, plus one smaller interval
-    *      within remainder of RAND_MAX */
-    if (base_random < RAND_MAX - remainder) {
-        return min + base_random/bucket;
+t_ring* ring_create(int depth, bool mpsc, bool shared) {
+    t_ring* ring;
+    unsigned int size = 1, i;
+
+    while (size < (unsigned int)depth)
+        size <<= 1;
+    ring = calloc(1, sizeof(t_ring));
+    if (ring == NULL)
+        return NULL;
+    ring->slot = calloc(size, sizeof(t_slot));
+    if (ring->slot == NULL) {
+        free(ring);
+        return NULL;
     }
-    else {
-        return random_in_range (min, max);
+    ring->mask = size - 1;
+    ring->mpsc = mpsc;
+    ring->shared = shared;
+    for (i = 0; i < size; i++)
+        ring->slot[i].seq = i;
+    return ring;
+}
+
+void ring_delete(t_ring* ring) {
+    free(ring->slot);
+    free(ring);
+}
+
+STATUS ring_send(t_ring* ring, t_msg* msg) {
+    unsigned int tail, seq;
+    int dif;
+    t_slot* slot;
+
+    if (!ring->mpsc) {
+        /* wait-free: one load of the own index, one store to publish */
+        tail = ring->tail;
+        if (tail - ring->head_cache > ring->mask) {
+            ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            if (tail - ring->head_cache > ring->mask) {
+                errno = S_objLib_OBJ_UNAVAILABLE;
+                return ERROR;
+            }
+        }
+        ring->slot[tail & ring->mask].msg = msg;
+        __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+        return OK;
+    }
+
+    /* claim a slot that the consumer has released for this lap */
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    while (1) {
+        slot = &ring->slot[tail & ring->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        dif = (int)(seq - tail);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (dif < 0) {
+            errno = S_objLib_OBJ_UNAVAILABLE;
+            return ERROR;
+        }
+        else {
+            tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->msg = msg;
+    __atomic_store_n(&slot->seq, tail + 1, __ATOMIC_RELEASE);
+    return OK;
+}
+
+/* the indices are read and written once per batch */
+int ring_receive_batch(t_ring* ring, t_msg** msgs, int max) {
+    unsigned int head = ring->head;
+    unsigned int avail;
+    t_slot* slot;
+    int n;
+
+    if (!ring->mpsc) {
+        avail = ring->tail_cache - head;
+        if (avail < (unsigned int)max) {
+            ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            avail = ring->tail_cache - head;
+        }
+        for (n = 0; n < max && (unsigned int)n < avail; n++)
+            msgs[n] = ring->slot[(head + n) & ring->mask].msg;
+        if (n > 0)
+            __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    /* a slot is full once its producer published position + 1 */
+    if (ring->shared) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        for (n = 0; n < max; ) {
+            slot = &ring->slot[head & ring->mask];
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1) {
+                /* empty, or taken by the other side in the meantime */
+                avail = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+                if (avail == head)
+                    break;
+                head = avail;
+            }
+            else if (__atomic_compare_exchange_n(&ring->head, &head, head + 1,
+                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                msgs[n++] = slot->msg;
+                __atomic_store_n(&slot->seq, head + ring->mask + 1, __ATOMIC_RELEASE);
+                head++;
+            }
+        }
+        return n;
+    }
+    for (n = 0; n < max; n++, head++) {
+        slot = &ring->slot[head & ring->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1)
+            break;
+        msgs[n] = slot->msg;
+        __atomic_store_n(&slot->seq, head + ring->mask + 1, __ATOMIC_RELEASE);
     }
+    ring->head = head;
+    return n;
+}
+
+
+/*************************************************************************/
+/*  message pool                                                         */
+/*                                                                       */
+/*  allocated once at startup; taking and returning a message is a CAS   */
+/*  on the top of the free stack, safe from several producers at once    */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS pool_create(t_pool* pool, int cnt) {
+    int i;
+
+    pool->msg = calloc(cnt, sizeof(t_msg));
+    pool->cnt = cnt;
+    pool->top = 0;
+    if (pool->msg == NULL)
+        return ERROR;
+    for (i = cnt - 1; i >= 0; i--)
+        msg_free(pool, &pool->msg[i]);
+    return OK;
+}
+
+void pool_delete(t_pool* pool) {
+    free(pool->msg);
+    pool->msg = NULL;
+}
+
+/* NULL when all messages are in use */
+t_msg* msg_alloc(t_pool* pool) {
+    unsigned long long top, next;
+    unsigned int idx;
+
+    top = __atomic_load_n(&pool->top, __ATOMIC_ACQUIRE);
+    do {
+        idx = (unsigned int)top;
+        if (idx == 0)
+            return NULL;
+        next = (((top >> 32) + 1) << 32)
+            | __atomic_load_n(&pool->msg[idx-1].next, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->top, &top, next, true,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return &pool->msg[idx-1];
+}
+
+void msg_free(t_pool* pool, t_msg* msg) {
+    unsigned long long top, next;
+    unsigned int idx = (unsigned int)(msg - pool->msg) + 1;
+
+    top = __atomic_load_n(&pool->top, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&msg->next, (unsigned int)top, __ATOMIC_RELAXED);
+        next = (((top >> 32) + 1) << 32) | idx;
+    } while (!__atomic_compare_exchange_n(&pool->top, &top, next, true,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
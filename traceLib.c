@@ -0,0 +1,504 @@
+/*************************************************************************/
+/*  traceLib.c                                                           */
+/*                                                                       */
+/*  asynchronous binary trace. Every task (and timer handler thread)     */
+/*  owns a single-producer ring of fixed-size records, claimed on its    */
+/*  first record, so recording is a clock read and a few stores without  */
+/*  locks or I/O. A low priority drainer merges the rings by time stamp  */
+/*  and formats the records; a full ring drops the record and counts it. */
+/*  The drainer hands the drained rings of deleted tasks on to new ones, */
+/*  and can also write the records as a Chrome trace-event timeline      */
+/*                                                                       */
+/*************************************************************************/
+
+/* includes */
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "time.h"
+#include "traceLib.h"
+
+/* defines */
+#define TRACE_CACHE_LINE 64
+#define TRACE_LINE       256
+#define TRACE_TRACK_NAME 32
+
+typedef struct trace_ring {
+    char pad0[TRACE_CACHE_LINE];
+    volatile unsigned int head;     /* drainer */
+    char pad1[TRACE_CACHE_LINE];
+    volatile unsigned int tail;     /* owner */
+    unsigned int dropped;           /* owner */
+    volatile int owner;             /* tid, 0: free for another task */
+    char pad2[TRACE_CACHE_LINE];
+    TRACE_REC rec[TRACE_RING_SIZE];
+} TRACE_RING;
+
+typedef struct trace_track {
+    int  tid;                       /* task track, 0: named track */
+    char name[TRACE_TRACK_NAME];
+} TRACE_TRACK;
+
+/* locals */
+static TRACE_RING* traceRings[TRACE_MAX_RINGS];
+static int traceRingCnt;
+static volatile int traceRingsFree;             /* owner 0 */
+static volatile unsigned long long traceLost;   /* no ring left */
+static volatile int traceRingless;              /* tasks that got none */
+static __thread TRACE_RING* traceRingSelf;
+static __thread BOOL traceRinglessSelf;
+
+static const char* const* traceFormats;
+static int traceEventCnt;
+static void (*tracePrefix)(FILE*, const TRACE_REC*);
+static FILE* traceOut;
+static long long (*traceClock)(void);
+static volatile BOOL traceOn = TRUE;
+static SEM_ID traceDrainSem;    /* one drainer at a time */
+static int tidTraceDrain = ERROR;
+
+static FILE* traceJson;         /* timeline, drainer only */
+static const TRACE_SPAN* traceSpans;
+static TRACE_TRACK traceTracks[TRACE_MAX_TRACKS];
+static int traceTrackCnt;
+static long long traceJsonCnt;
+
+/* forward declarations */
+static long long traceClockDefault(void);
+static TRACE_RING* traceRingClaim(void);
+static void traceRingReclaim(void);
+static void traceDrain(void);
+static void traceDrainTask(void);
+static void traceFormat(char* buf, int size, const char* fmt,
+                        const long long* arg);
+static void traceJsonWrite(const TRACE_REC* rec, const char* text);
+static int  traceJsonTrack(int tid, const char* name);
+static void traceJsonString(const char* str);
+
+
+/*************************************************************************/
+/*  recording                                                            */
+/*                                                                       */
+/*************************************************************************/
+
+void traceRecord(int level, int event, long long a0, long long a1,
+        long long a2, long long a3, long long a4, long long a5) {
+    TRACE_RING* ring = traceRingSelf;
+    TRACE_REC* rec;
+    unsigned int tail;
+
+    if (!traceOn)
+        return;
+    if (ring == NULL && (ring = traceRingClaim()) == NULL) {
+        __atomic_fetch_add(&traceLost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+    rec = &ring->rec[tail & (TRACE_RING_SIZE - 1)];
+    rec->stamp = (traceClock != NULL) ? traceClock() : traceClockDefault();
+    rec->tid = taskIdSelf();
+    rec->event = (short)event;
+    rec->level = (short)level;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+    rec->arg[4] = a4;
+    rec->arg[5] = a5;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* the ring of the calling thread, a free one or else a new one; NULL if
+ * none is left, the thread is counted the first time */
+static TRACE_RING* traceRingClaim(void) {
+    TRACE_RING* ring = NULL;
+    int i, idx, cnt, none = 0;
+    int self = taskIdSelf();
+
+    if (__atomic_load_n(&traceRingsFree, __ATOMIC_ACQUIRE) > 0) {
+        cnt = __atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED);
+        for (i = 0; i < cnt && i < TRACE_MAX_RINGS; i++) {
+            ring = __atomic_load_n(&traceRings[i], __ATOMIC_ACQUIRE);
+            if (ring != NULL && ring->owner == 0
+                    && __atomic_compare_exchange_n(&ring->owner, &none, self,
+                        0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                __atomic_sub_fetch(&traceRingsFree, 1, __ATOMIC_RELAXED);
+                traceRingSelf = ring;
+                return ring;
+            }
+            none = 0;
+        }
+    }
+
+    if (__atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED) < TRACE_MAX_RINGS
+            && (idx = __atomic_fetch_add(&traceRingCnt, 1, __ATOMIC_RELAXED))
+                < TRACE_MAX_RINGS
+            && (ring = calloc(1, sizeof(TRACE_RING))) != NULL) {
+        ring->owner = self;
+        __atomic_store_n(&traceRings[idx], ring, __ATOMIC_RELEASE);
+        traceRingSelf = ring;
+        return ring;
+    }
+
+    if (!traceRinglessSelf) {
+        traceRinglessSelf = TRUE;
+        __atomic_add_fetch(&traceRingless, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* free the rings of the deleted tasks once they are drained */
+static void traceRingReclaim(void) {
+    int i, cnt = __atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED);
+    TRACE_RING* ring;
+
+    for (i = 0; i < cnt && i < TRACE_MAX_RINGS; i++) {
+        ring = __atomic_load_n(&traceRings[i], __ATOMIC_ACQUIRE);
+        if (ring == NULL || ring->owner == 0
+                || ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+                || taskIdVerify(ring->owner) == OK)
+            continue;
+        __atomic_store_n(&ring->owner, 0, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&traceRingsFree, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* CLOCK_REALTIME in ns */
+static long long traceClockDefault(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void traceEnable(BOOL enable) {
+    traceOn = enable;
+}
+
+/* time stamps from another clock, e.g. a simulated one; NULL: default */
+void traceClockSet(long long (*clock)(void)) {
+    traceClock = clock;
+}
+
+
+/*************************************************************************/
+/*  draining                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+/* formats is indexed by event, events with a NULL format are not written
+ * to out; prefix, if not NULL, writes the start of each line. Spawns the
+ * drainer at TRACE_PRIORITY */
+STATUS traceStart(const char* const* formats, int eventCnt,
+        void (*prefix)(FILE*, const TRACE_REC*), FILE* out) {
+    traceFormats = formats;
+    traceEventCnt = eventCnt;
+    tracePrefix = prefix;
+    traceOut = out;
+    if ((traceDrainSem = semBCreate(SEM_Q_FIFO, SEM_FULL)) == NULL)
+        return ERROR;
+    tidTraceDrain = taskSpawn("tTraceDrain", TRACE_PRIORITY, 0, 20000,
+            (FUNCPTR)traceDrainTask, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    return (tidTraceDrain == ERROR) ? ERROR : OK;
+}
+
+/* stop the drainer, write what is left and report the records lost */
+void traceStop(void) {
+    unsigned long long dropped;
+
+    if (traceDrainSem == NULL)
+        return;
+    semTake(traceDrainSem, WAIT_FOREVER);
+    if (tidTraceDrain != ERROR)
+        taskDelete(tidTraceDrain);
+    tidTraceDrain = ERROR;
+    traceDrain();
+    semGive(traceDrainSem);
+
+    if ((dropped = traceDropped()) > 0 && traceOut != NULL)
+        fprintf(traceOut, "trace: %llu records dropped\n", dropped);
+    if (traceRingless > 0 && traceOut != NULL)
+        fprintf(traceOut, "trace: %d tasks got no ring, raise TRACE_MAX_RINGS "
+                "above %d\n", traceRingless, TRACE_MAX_RINGS);
+    if (traceJson != NULL) {
+        fprintf(traceJson, "\n]\n");
+        fclose(traceJson);
+        traceJson = NULL;
+    }
+    semDelete(traceDrainSem);
+    traceDrainSem = NULL;
+}
+
+/* drain in the context of the caller, e.g. from a simulation that does
+ * not give the drainer a chance to run */
+void traceFlush(void) {
+    int i, cnt = __atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED);
+    TRACE_RING* ring;
+
+    if (traceDrainSem == NULL)
+        return;
+    for (i = 0; i < cnt && i < TRACE_MAX_RINGS; i++) {
+        ring = __atomic_load_n(&traceRings[i], __ATOMIC_ACQUIRE);
+        if (ring != NULL && ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+            break;
+    }
+    if (i == cnt || i == TRACE_MAX_RINGS)
+        return;     /* nothing to write */
+    semTake(traceDrainSem, WAIT_FOREVER);
+    traceDrain();
+    semGive(traceDrainSem);
+}
+
+unsigned long long traceDropped(void) {
+    unsigned long long dropped = traceLost;
+    int i, cnt = __atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED);
+
+    for (i = 0; i < cnt && i < TRACE_MAX_RINGS; i++) {
+        if (traceRings[i] != NULL)
+            dropped += traceRings[i]->dropped;
+    }
+    return dropped;
+}
+
+/* drains every TRACE_DRAIN_NS on CLOCK_MONOTONIC, which the programs do
+ * not set; a late round starts the next period from now */
+static void traceDrainTask(void) {
+    struct timespec now, next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (1) {
+        semTake(traceDrainSem, WAIT_FOREVER);
+        traceDrain();
+        semGive(traceDrainSem);
+        traceRingReclaim();
+
+        next.tv_nsec += TRACE_DRAIN_NS % 1000000000LL;
+        next.tv_sec += TRACE_DRAIN_NS / 1000000000LL + next.tv_nsec / 1000000000LL;
+        next.tv_nsec %= 1000000000LL;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec
+                || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+            next = now;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+
+/* write the records that are in the rings now, oldest first. Each ring is
+ * in order already, so the oldest is always at the head of one of them */
+static void traceDrain(void) {
+    unsigned int head[TRACE_MAX_RINGS];
+    unsigned int tail[TRACE_MAX_RINGS];
+    TRACE_RING* ring[TRACE_MAX_RINGS];
+    TRACE_REC* rec;
+    TRACE_REC* first;
+    char line[TRACE_LINE];
+    const char* fmt;
+    int i, cnt, next;
+
+    cnt = __atomic_load_n(&traceRingCnt, __ATOMIC_RELAXED);
+    if (cnt > TRACE_MAX_RINGS)
+        cnt = TRACE_MAX_RINGS;
+    for (i = 0; i < cnt; i++) {
+        ring[i] = __atomic_load_n(&traceRings[i], __ATOMIC_ACQUIRE);
+        if (ring[i] == NULL)
+            continue;
+        head[i] = ring[i]->head;
+        tail[i] = __atomic_load_n(&ring[i]->tail, __ATOMIC_ACQUIRE);
+    }
+
+    while (1) {
+        first = NULL;
+        next = -1;
+        for (i = 0; i < cnt; i++) {
+            if (ring[i] == NULL || head[i] == tail[i])
+                continue;
+            rec = &ring[i]->rec[head[i] & (TRACE_RING_SIZE - 1)];
+            if (first == NULL || rec->stamp < first->stamp) {
+                first = rec;
+                next = i;
+            }
+        }
+        if (first == NULL)
+            break;
+
+        if (first->event >= 0 && first->event < traceEventCnt) {
+            fmt = traceFormats[first->event];
+            if (fmt != NULL)
+                traceFormat(line, sizeof(line), fmt, first->arg);
+            if (traceOut != NULL && fmt != NULL) {
+                if (tracePrefix != NULL)
+                    tracePrefix(traceOut, first);
+                fputs(line, traceOut);
+            }
+            if (traceJson != NULL)
+                traceJsonWrite(first, (fmt != NULL) ? line : NULL);
+        }
+        head[next]++;
+        __atomic_store_n(&ring[next]->head, head[next], __ATOMIC_RELEASE);
+    }
+    if (traceOut != NULL)
+        fflush(traceOut);
+    if (traceJson != NULL)
+        fflush(traceJson);
+}
+
+/* printf with the record arguments: each conversion takes the next one,
+ * as a string for %s, as a character for %c and as a long long for the
+ * integer conversions; other conversions print as '?' */
+static void traceFormat(char* buf, int size, const char* fmt,
+        const long long* arg) {
+    char spec[16];
+    int len = 0, n, k, a = 0;
+    char conv;
+
+    while (*fmt != '\0' && len < size - 1) {
+        if (*fmt != '%') {
+            buf[len++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            buf[len++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        /* copy flags, width and precision, drop length modifiers */
+        k = 0;
+        spec[k++] = *fmt++;
+        while (*fmt != '\0' && strchr("-+ #0123456789.", *fmt) != NULL
+                && k < (int)sizeof(spec) - 4)
+            spec[k++] = *fmt++;
+        while (*fmt != '\0' && strchr("hlLqjzt", *fmt) != NULL)
+            fmt++;
+        if ((conv = *fmt) == '\0')
+            break;
+        fmt++;
+
+        if (a >= TRACE_ARGS) {
+            n = snprintf(buf + len, size - len, "?");
+        }
+        else if (conv == 's') {
+            spec[k++] = 's';
+            spec[k] = '\0';
+            n = snprintf(buf + len, size - len, spec, (arg[a] != 0)
+                    ? (const char*)(intptr_t)arg[a] : "(null)");
+        }
+        else if (conv == 'c') {
+            spec[k++] = 'c';
+            spec[k] = '\0';
+            n = snprintf(buf + len, size - len, spec, (int)arg[a]);
+        }
+        else if (strchr("diouxX", conv) != NULL) {
+            spec[k++] = 'l';
+            spec[k++] = 'l';
+            spec[k++] = conv;
+            spec[k] = '\0';
+            n = snprintf(buf + len, size - len, spec, arg[a]);
+        }
+        else {
+            n = snprintf(buf + len, size - len, "?");
+        }
+        a++;
+        if (n > 0)
+            len = (len + n < size - 1) ? len + n : size - 1;
+    }
+    buf[len] = '\0';
+}
+
+
+/*************************************************************************/
+/*  timeline                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+/* write the records to path as well, as Chrome trace events with one
+ * track per task or per track named in the spans table, which is indexed
+ * by event like the formats. Call before traceStart */
+STATUS traceExport(const char* path, const TRACE_SPAN* spans) {
+    if ((traceJson = fopen(path, "w")) == NULL)
+        return ERROR;
+    traceSpans = spans;
+    traceTrackCnt = 0;
+    traceJsonCnt = 0;
+    fprintf(traceJson, "[");
+    return OK;
+}
+
+/* one trace event, the formatted text goes into its arguments */
+static void traceJsonWrite(const TRACE_REC* rec, const char* text) {
+    const TRACE_SPAN* span = &traceSpans[rec->event];
+    const char* track = span->track;
+    int id;
+
+    if (span->phase == 0)
+        return;
+    if (span->trackArg >= 0 && span->trackArg < TRACE_ARGS
+            && rec->arg[(int)span->trackArg] != 0)
+        track = (const char*)(intptr_t)rec->arg[(int)span->trackArg];
+    if (track != NULL)
+        id = traceJsonTrack(0, track);
+    else
+        id = traceJsonTrack(rec->tid, taskName(rec->tid));
+
+    fprintf(traceJson, "%s\n{\"name\":\"", (traceJsonCnt++ > 0) ? "," : "");
+    traceJsonString((span->name != NULL) ? span->name
+            : (id > 0) ? traceTracks[id-1].name : "");
+    fprintf(traceJson, "\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":1,\"tid\":%d",
+            span->phase, rec->stamp / 1000, rec->stamp % 1000, id);
+    if (span->phase == 'i')
+        fprintf(traceJson, ",\"s\":\"t\"");
+    if (text != NULL) {
+        fprintf(traceJson, ",\"args\":{\"msg\":\"");
+        traceJsonString(text);
+        fprintf(traceJson, "\"}");
+    }
+    fprintf(traceJson, "}");
+}
+
+/* id of the track of a task (tid) or of a name, named by a metadata event
+ * when first seen; 0 once the table is full */
+static int traceJsonTrack(int tid, const char* name) {
+    TRACE_TRACK* track;
+    int i;
+
+    for (i = 0; i < traceTrackCnt; i++) {
+        track = &traceTracks[i];
+        if ((tid != 0) ? (track->tid == tid)
+                : (track->tid == 0 && strcmp(track->name, name) == 0))
+            return i + 1;
+    }
+    if (traceTrackCnt == TRACE_MAX_TRACKS)
+        return 0;
+
+    track = &traceTracks[traceTrackCnt++];
+    track->tid = tid;
+    if (name != NULL)
+        snprintf(track->name, sizeof(track->name), "%s", name);
+    else
+        snprintf(track->name, sizeof(track->name), "task %d", tid);
+    fprintf(traceJson, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"", (traceJsonCnt++ > 0) ? "," : "",
+            traceTrackCnt);
+    traceJsonString(track->name);
+    fprintf(traceJson, "\"}}");
+    return traceTrackCnt;
+}
+
+/* a JSON string body, without the line feeds */
+static void traceJsonString(const char* str) {
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(traceJson, "\\%c", *str);
+        else if ((unsigned char)*str >= 0x20)
+            fputc(*str, traceJson);
+        else if (*str != '\n')
+            fprintf(traceJson, "\\u%04x", *str);
+    }
+}
@@ -0,0 +1,81 @@
+/*************************************************************************/
+/*  traceLib.h                                                           */
+/*                                                                       */
+/*  asynchronous binary trace: tasks append fixed-size records to a      */
+/*  ring of their own, a low priority task formats them later            */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCtraceLibh
+#define __INCtraceLibh
+
+#include "vxWorks.h"
+#include "stdio.h"
+
+/* levels, a record is kept if its level is at most TRACE_LEVEL */
+#define TRACE_ERROR    1
+#define TRACE_WARNING  2
+#define TRACE_INFO     3
+#define TRACE_DEBUG    4
+
+/* compile-time filter, e.g. -DTRACE_LEVEL=TRACE_WARNING */
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL    TRACE_DEBUG
+#endif
+
+#define TRACE_ARGS        6     /* a record is 64 bytes */
+#define TRACE_RING_SIZE   4096  /* records per task, power of 2 */
+#define TRACE_DRAIN_NS    100000000LL   /* drainer period, 100 ms */
+#define TRACE_PRIORITY    250
+#define TRACE_MAX_TRACKS  256   /* timeline tracks */
+
+/* rings of the tasks alive at a time, those of deleted tasks are reused;
+ * the tasks beyond go without and are counted */
+#ifndef TRACE_MAX_RINGS
+#define TRACE_MAX_RINGS   128
+#endif
+
+/* the event selects a printf format of the table given to traceStart;
+ * its arguments are integers, or pointers to strings for %s */
+typedef struct trace_rec {
+    long long stamp;            /* ns of the trace clock */
+    int       tid;              /* task that recorded it */
+    short     event;
+    short     level;
+    long long arg[TRACE_ARGS];
+} TRACE_REC;
+
+/* how an event shows on the timeline written by traceExport, a Chrome
+ * trace-event file that Perfetto and chrome://tracing open. Events with
+ * phase 0 are left out */
+typedef struct trace_span {
+    char        phase;          /* 'B' begin, 'E' end of a slice, 'i' instant */
+    signed char trackArg;       /* %s argument naming the track, -1: none */
+    const char* track;          /* track if no trackArg, NULL: the task */
+    const char* name;           /* slice name, NULL: the track name */
+} TRACE_SPAN;
+
+/* record an event with up to TRACE_ARGS arguments; compiled out above
+ * TRACE_LEVEL. At least one argument is needed, 0 if there is none */
+#define TRACE(level, event, ...)                                          \
+    do {                                                                  \
+        if ((level) <= TRACE_LEVEL)                                       \
+            traceRecord((level), (event),                                 \
+                    TRACE_ARGS_(__VA_ARGS__, 0, 0, 0, 0, 0, 0));          \
+    } while (0)
+#define TRACE_ARGS_(a, b, c, d, e, f, ...)                                \
+    (long long)(a), (long long)(b), (long long)(c), (long long)(d),       \
+    (long long)(e), (long long)(f)
+
+STATUS traceStart(const char* const* formats, int eventCnt,
+                  void (*prefix)(FILE*, const TRACE_REC*), FILE* out);
+void   traceStop(void);
+STATUS traceExport(const char* path, const TRACE_SPAN* spans);
+void   traceFlush(void);
+void   traceEnable(BOOL enable);
+void   traceClockSet(long long (*clock)(void));
+void   traceRecord(int level, int event, long long a0, long long a1,
+                   long long a2, long long a3, long long a4, long long a5);
+unsigned long long traceDropped(void);
+
+#endif /* __INCtraceLibh */
@@ -0,0 +1,441 @@
+/*************************************************************************/
+/*  wheelLib.c                                                           */
+/*                                                                       */
+/*  hierarchical timing wheel. A timer sits in the slot of its expiry    */
+/*  tick on the lowest level that reaches that far; as the wheel turns,  */
+/*  the slots of the upper levels cascade down. A bitmap per level finds */
+/*  the next slot in use, so the single POSIX timer of the wheel is only */
+/*  set for the earliest expiry, and only when that one changes. Due     */
+/*  timers are collected under the lock and run after, one batch per    */
+/*  expiry of the POSIX timer                                            */
+/*                                                                       */
+/*************************************************************************/
+
+/* includes */
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "time.h"
+#include "sigLib.h"
+#include "wheelLib.h"
+
+/* defines */
+#define WHEEL_SLOTS    (1 << WHEEL_BITS)
+#define WHEEL_MASK     (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE    (1LL << (WHEEL_BITS * WHEEL_LEVELS))    /* ticks */
+#define WHEEL_IDLE     (-1)     /* not started */
+#define WHEEL_EXPIRED  (-2)     /* due, on the expired list */
+#define WHEEL_RUNNING  (-3)     /* its routine is being called */
+#define WHEEL_STACK    20000
+#define WHEEL_NAME     32
+
+struct wheel {
+    SEM_ID        lock;
+    SEM_ID        ready;        /* the wheel task has set up its timer */
+    SEM_ID        done;         /* a routine returned, one give per waiter */
+    int           doneWaiters;  /* cancellers waiting for it */
+    int           tid;
+    timer_t       timer;
+    BOOL          timerOk;
+    long long     armed;        /* what the timer is set to, 0: nothing */
+    long long     cur;          /* tick the wheel has turned to */
+    unsigned long long map[WHEEL_LEVELS];          /* slots in use */
+    WHEEL_TIMER*  slot[WHEEL_LEVELS * WHEEL_SLOTS];
+    WHEEL_TIMER*  expired;
+    WHEEL_TIMER** expiredTail;
+    WHEEL_TIMER* volatile running;     /* whose routine is being called */
+    char          name[WHEEL_NAME];
+
+    /* statistics */
+    unsigned long long fired;
+    unsigned long long expiries;
+    unsigned long long cascaded;
+    unsigned long long armCnt;
+    long long     lateSum;
+    long long     lateMax;
+};
+
+/* forward declarations */
+static void wheelTask(WHEEL_ID wheel);
+static void wheelExpire(timer_t timerId, WHEEL_ID wheel);
+static void wheelAdvance(WHEEL_ID wheel, long long now);
+static void wheelCascade(WHEEL_ID wheel);
+static long long wheelNext(WHEEL_ID wheel);
+static void wheelArm(WHEEL_ID wheel, long long when);
+static void wheelLink(WHEEL_ID wheel, WHEEL_TIMER* timer);
+static void wheelUnlink(WHEEL_ID wheel, WHEEL_TIMER* timer);
+static void wheelExpiredAdd(WHEEL_ID wheel, WHEEL_TIMER* timer);
+static int  wheelNextBit(unsigned long long map, int from);
+static long long wheelNow(void);
+
+
+/*************************************************************************/
+/*  wheels                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+/* spawns the wheel task, which owns the POSIX timer and so runs the
+ * routines of the timers at the given priority on the given CPUs (an
+ * empty set: any). NULL if the task or its timer cannot be set up */
+WHEEL_ID wheelCreate(char* name, int priority, cpuset_t affinity) {
+    WHEEL_ID wheel;
+
+    if ((wheel = calloc(1, sizeof(struct wheel))) == NULL)
+        return NULL;
+    strncpy(wheel->name, name, WHEEL_NAME - 1);
+    wheel->expiredTail = &wheel->expired;
+    wheel->cur = wheelNow() >> WHEEL_SHIFT;
+    wheel->tid = ERROR;
+    wheel->lock = semMCreate(SEM_Q_PRIORITY | SEM_INVERSION_SAFE);
+    wheel->ready = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+    wheel->done = semCCreate(SEM_Q_FIFO, 0);
+    if (wheel->lock == NULL || wheel->ready == NULL || wheel->done == NULL)
+        goto fail;
+
+    wheel->tid = taskCreate(name, priority, 0, WHEEL_STACK, (FUNCPTR)wheelTask,
+            (_Vx_usr_arg_t)wheel, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    if (wheel->tid == ERROR)
+        goto fail;
+    if (!CPUSET_ISZERO(affinity) && taskCpuAffinitySet(wheel->tid, affinity) == ERROR)
+        goto fail;
+    taskActivate(wheel->tid);
+    semTake(wheel->ready, WAIT_FOREVER);
+    if (!wheel->timerOk)
+        goto fail;
+    return wheel;
+
+fail:
+    if (wheel->tid != ERROR)
+        taskDelete(wheel->tid);
+    if (wheel->lock != NULL)
+        semDelete(wheel->lock);
+    if (wheel->ready != NULL)
+        semDelete(wheel->ready);
+    if (wheel->done != NULL)
+        semDelete(wheel->done);
+    free(wheel);
+    return NULL;
+}
+
+/* the timers still started are dropped, their memory is the caller's */
+STATUS wheelDelete(WHEEL_ID wheelId) {
+    if (wheelId == NULL)
+        return ERROR;
+    taskDelete(wheelId->tid);
+    semDelete(wheelId->lock);
+    semDelete(wheelId->ready);
+    semDelete(wheelId->done);
+    free(wheelId);
+    return OK;
+}
+
+void wheelShow(WHEEL_ID w) {
+    if (w == NULL)
+        return;
+    printf("%s: %llu timers fired in %llu expiries (%.2f each), %llu cascaded, "
+            "%llu timer_settime\n", w->name, w->fired, w->expiries,
+            w->expiries ? (double)w->fired / w->expiries : 0.0, w->cascaded,
+            w->armCnt);
+    printf("%s: late by %.3fms on average, %.3fms at most\n", w->name,
+            w->fired ? (double)w->lateSum / w->fired / 1e6 : 0.0,
+            w->lateMax / 1e6);
+}
+
+static void wheelTask(WHEEL_ID wheel) {
+    wheel->timerOk = timer_create(CLOCK_REALTIME, NULL, &wheel->timer) != ERROR
+        && timer_connect(wheel->timer, (VOIDFUNCPTR)wheelExpire,
+                (_Vx_usr_arg_t)wheel) != ERROR;
+    semGive(wheel->ready);
+
+    /* idle loop */
+    while (1) pause();
+}
+
+
+/*************************************************************************/
+/*  timers                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+STATUS wheelTimerInit(WHEEL_TIMER* timer, WHEEL_ID wheelId,
+        VOIDFUNCPTR routine, _Vx_usr_arg_t arg) {
+    if (timer == NULL || wheelId == NULL)
+        return ERROR;
+    memset(timer, 0, sizeof(WHEEL_TIMER));
+    timer->wheel = wheelId;
+    timer->slot = WHEEL_IDLE;
+    timer->routine = routine;
+    timer->arg = arg;
+    return OK;
+}
+
+/* (re)start for the absolute CLOCK_REALTIME expiry, ns; one in the past
+ * expires right away. With an interval it restarts itself after each
+ * call of its routine, on the expiry it had plus the interval */
+STATUS wheelTimerStart(WHEEL_TIMER* timer, long long expiry, long long interval) {
+    WHEEL_ID wheel;
+
+    if (timer == NULL || (wheel = timer->wheel) == NULL)
+        return ERROR;
+    semTake(wheel->lock, WAIT_FOREVER);
+    if (timer->slot >= 0 || timer->slot == WHEEL_EXPIRED)
+        wheelUnlink(wheel, timer);
+    timer->expiry = expiry;
+    timer->interval = interval;
+    wheelLink(wheel, timer);
+    if (wheel->armed == 0 || expiry < wheel->armed)
+        wheelArm(wheel, expiry);
+    semGive(wheel->lock);
+    return OK;
+}
+
+/* if its routine is being called, waits for it to return, unless the
+ * routine itself or another one of the wheel cancels it */
+STATUS wheelTimerCancel(WHEEL_TIMER* timer) {
+    WHEEL_ID wheel;
+
+    if (timer == NULL || (wheel = timer->wheel) == NULL)
+        return ERROR;
+    semTake(wheel->lock, WAIT_FOREVER);
+    if (timer->slot >= 0 || timer->slot == WHEEL_EXPIRED)
+        wheelUnlink(wheel, timer);
+    timer->slot = WHEEL_IDLE;
+    if (wheel->running == timer && taskIdSelf() != wheel->tid) {
+        wheel->doneWaiters++;
+        semGive(wheel->lock);
+        semTake(wheel->done, WAIT_FOREVER);
+        return OK;
+    }
+    semGive(wheel->lock);
+    return OK;
+}
+
+
+/*************************************************************************/
+/*  expiry                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+/* handler of the POSIX timer: turn the wheel to now, set the timer for
+ * what comes next, then call the routines of the due timers unlocked,
+ * so that they can start and cancel timers themselves */
+static void wheelExpire(timer_t timerId, WHEEL_ID wheel) {
+    WHEEL_TIMER* timer;
+    long long late, next;
+    (void)timerId;
+
+    semTake(wheel->lock, WAIT_FOREVER);
+    wheel->armed = 0;
+    wheel->expiries++;
+    wheelAdvance(wheel, wheelNow());
+    if ((next = wheelNext(wheel)) != 0)
+        wheelArm(wheel, next);
+
+    while ((timer = wheel->expired) != NULL) {
+        wheelUnlink(wheel, timer);
+        timer->slot = WHEEL_RUNNING;
+        late = wheelNow() - timer->expiry;
+        wheel->fired++;
+        wheel->lateSum += late;
+        if (late > wheel->lateMax)
+            wheel->lateMax = late;
+        wheel->running = timer;
+        semGive(wheel->lock);
+
+        if (timer->routine != NULL)
+            timer->routine(timer, timer->arg);
+
+        semTake(wheel->lock, WAIT_FOREVER);
+        wheel->running = NULL;
+        for (; wheel->doneWaiters > 0; wheel->doneWaiters--)
+            semGive(wheel->done);
+        if (timer->slot != WHEEL_RUNNING)
+            continue;   /* restarted or cancelled by now */
+        if (timer->interval > 0) {
+            timer->expiry += timer->interval;
+            wheelLink(wheel, timer);
+            if (wheel->armed == 0 || timer->expiry < wheel->armed)
+                wheelArm(wheel, timer->expiry);
+        }
+        else
+            timer->slot = WHEEL_IDLE;
+    }
+    semGive(wheel->lock);
+}
+
+/* move the timers due by now to the expired list. The wheel only stops
+ * at the ticks in use on level 0 and where a slot in use on an upper
+ * level cascades, both found in the bitmaps, so an idle stretch costs a
+ * step per level at most */
+static void wheelAdvance(WHEEL_ID wheel, long long now) {
+    long long tick = now >> WHEEL_SHIFT, next, at;
+    WHEEL_TIMER* timer;
+    WHEEL_TIMER* tnext;
+    int d, level, shift;
+
+    while (1) {
+        /* a timer of the current tick may expire later within the tick */
+        for (timer = wheel->slot[wheel->cur & WHEEL_MASK]; timer != NULL; timer = tnext) {
+            tnext = timer->next;
+            if (timer->expiry <= now) {
+                wheelUnlink(wheel, timer);
+                wheelExpiredAdd(wheel, timer);
+            }
+        }
+        if (wheel->cur >= tick)
+            break;
+
+        next = tick;
+        d = wheelNextBit(wheel->map[0], (int)((wheel->cur + 1) & WHEEL_MASK));
+        if (d >= 0 && wheel->cur + 1 + d < next)
+            next = wheel->cur + 1 + d;
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            shift = WHEEL_BITS * level;
+            at = (wheel->cur >> shift) + 1;
+            d = wheelNextBit(wheel->map[level], (int)(at & WHEEL_MASK));
+            if (d >= 0 && (at + d) << shift < next)
+                next = (at + d) << shift;
+        }
+        wheel->cur = next;
+        if ((next & WHEEL_MASK) == 0)
+            wheelCascade(wheel);
+    }
+}
+
+/* relink the slots of the upper levels whose turn starts at the current
+ * tick, top down, so that what comes from above cascades on in one go */
+static void wheelCascade(WHEEL_ID wheel) {
+    WHEEL_TIMER* timer;
+    WHEEL_TIMER* tnext;
+    int level, idx;
+
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if ((wheel->cur & ((1LL << (WHEEL_BITS * level)) - 1)) != 0)
+            continue;
+        idx = (int)((wheel->cur >> (WHEEL_BITS * level)) & WHEEL_MASK);
+        timer = wheel->slot[(level << WHEEL_BITS) | idx];
+        wheel->slot[(level << WHEEL_BITS) | idx] = NULL;
+        wheel->map[level] &= ~(1ULL << idx);
+        for (; timer != NULL; timer = tnext) {
+            tnext = timer->next;
+            wheelLink(wheel, timer);
+            wheel->cascaded++;
+        }
+    }
+}
+
+/* the earliest expiry, 0 if there are no timers. On every level the
+ * first slot in use holds the earliest timers of that level; the wheel
+ * cascades on its way there, so it does not have to wake up for that */
+static long long wheelNext(WHEEL_ID wheel) {
+    long long next = 0, tick;
+    WHEEL_TIMER* timer;
+    int d, level;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        tick = wheel->cur >> (WHEEL_BITS * level);
+        if (level > 0)
+            tick++;     /* the current slot has cascaded already */
+        d = wheelNextBit(wheel->map[level], (int)(tick & WHEEL_MASK));
+        if (d < 0)
+            continue;
+        timer = wheel->slot[(level << WHEEL_BITS) | (int)((tick + d) & WHEEL_MASK)];
+        for (; timer != NULL; timer = timer->next) {
+            if (next == 0 || timer->expiry < next)
+                next = timer->expiry;
+        }
+    }
+    return next;
+}
+
+static void wheelArm(WHEEL_ID wheel, long long when) {
+    struct itimerspec value;
+
+    /* a zero it_value would disarm it */
+    if (when < 1)
+        when = 1;
+    value.it_value.tv_sec = when / 1000000000LL;
+    value.it_value.tv_nsec = when % 1000000000LL;
+    value.it_interval.tv_sec = 0;
+    value.it_interval.tv_nsec = 0;
+    if (timer_settime(wheel->timer, TIMER_ABSTIME, &value, NULL) == ERROR)
+        return;
+    wheel->armed = when;
+    wheel->armCnt++;
+}
+
+
+/*************************************************************************/
+/*  slots                                                                */
+/*                                                                       */
+/*************************************************************************/
+
+/* into the slot of its tick on the lowest level that reaches it; past
+ * the last level it waits in the farthest slot and is relinked from
+ * there when that cascades */
+static void wheelLink(WHEEL_ID wheel, WHEEL_TIMER* timer) {
+    long long tick = timer->expiry >> WHEEL_SHIFT, delta;
+    WHEEL_TIMER** head;
+    int level = 0, idx;
+
+    if (tick < wheel->cur)
+        tick = wheel->cur;
+    delta = tick - wheel->cur;
+    if (delta >= WHEEL_RANGE) {
+        delta = WHEEL_RANGE - 1;
+        tick = wheel->cur + delta;
+    }
+    while (delta >= 1LL << (WHEEL_BITS * (level + 1)))
+        level++;
+    idx = (int)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    head = &wheel->slot[(level << WHEEL_BITS) | idx];
+    timer->next = *head;
+    if (timer->next != NULL)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+    timer->slot = (level << WHEEL_BITS) | idx;
+    wheel->map[level] |= 1ULL << idx;
+}
+
+static void wheelUnlink(WHEEL_ID wheel, WHEEL_TIMER* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL)
+        timer->next->pprev = timer->pprev;
+    else if (timer->slot == WHEEL_EXPIRED)
+        wheel->expiredTail = timer->pprev;
+    if (timer->slot >= 0 && wheel->slot[timer->slot] == NULL)
+        wheel->map[timer->slot >> WHEEL_BITS] &= ~(1ULL << (timer->slot & WHEEL_MASK));
+    timer->slot = WHEEL_IDLE;
+}
+
+/* at the tail, so a batch runs in the order of the ticks */
+static void wheelExpiredAdd(WHEEL_ID wheel, WHEEL_TIMER* timer) {
+    timer->next = NULL;
+    timer->pprev = wheel->expiredTail;
+    *wheel->expiredTail = timer;
+    wheel->expiredTail = &timer->next;
+    timer->slot = WHEEL_EXPIRED;
+}
+
+/* distance from bit from, going round, to the first bit set; -1: none */
+static int wheelNextBit(unsigned long long map, int from) {
+    unsigned long long rot;
+
+    if (map == 0)
+        return -1;
+    rot = (from == 0) ? map : (map >> from) | (map << (WHEEL_SLOTS - from));
+    return __builtin_ctzll(rot);
+}
+
+/* CLOCK_REALTIME in ns */
+static long long wheelNow(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
@@ -0,0 +1,43 @@
+/*************************************************************************/
+/*  wheelLib.h                                                           */
+/*                                                                       */
+/*  hierarchical timing wheel: many software timers on a single POSIX    */
+/*  timer, started and cancelled in O(1), expired in batches             */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef __INCwheelLibh
+#define __INCwheelLibh
+
+#include "vxWorks.h"
+#include "taskLib.h"
+
+#define WHEEL_SHIFT   16    /* a tick is 2^16 ns, 65.5 us */
+#define WHEEL_BITS    6     /* 64 slots per level, a bitmap word */
+#define WHEEL_LEVELS  4     /* 2^40 ns ahead, 18 minutes */
+
+typedef struct wheel* WHEEL_ID;
+
+/* owned by the caller, the wheel only links it; the routine is called
+ * as routine(timer, arg) in the context of the wheel task */
+typedef struct wheel_timer {
+    struct wheel_timer*  next;
+    struct wheel_timer** pprev;
+    WHEEL_ID       wheel;
+    int            slot;        /* where it is linked, < 0: not in a slot */
+    long long      expiry;      /* CLOCK_REALTIME ns */
+    long long      interval;    /* ns, 0: one-shot */
+    VOIDFUNCPTR    routine;
+    _Vx_usr_arg_t  arg;
+} WHEEL_TIMER;
+
+WHEEL_ID wheelCreate(char* name, int priority, cpuset_t affinity);
+STATUS   wheelDelete(WHEEL_ID wheelId);
+void     wheelShow(WHEEL_ID wheelId);
+STATUS   wheelTimerInit(WHEEL_TIMER* timer, WHEEL_ID wheelId,
+                        VOIDFUNCPTR routine, _Vx_usr_arg_t arg);
+STATUS   wheelTimerStart(WHEEL_TIMER* timer, long long expiry,
+                         long long interval);
+STATUS   wheelTimerCancel(WHEEL_TIMER* timer);
+
+#endif /* __INCwheelLibh */